@@ -1,16 +1,20 @@
 #version 330 core
 
-layout (location = 0) in vec3 in_position;
-layout (location = 1) in vec3 in_color;
-layout (location = 2) in vec3 in_tex_coord;
+layout (location = 0) in vec4 in_rect;
+layout (location = 1) in vec4 in_uv_rect;
+layout (location = 2) in vec4 in_color;
+layout (location = 3) in float in_layer;
 
-out vec3 vertex_color;
-out vec3 vertex_tex_coord;
+out vec4 vertex_color;
+out vec2 vertex_tex_coord;
 
 uniform mat4 projection_matrix;
 
 void main() {
-    gl_Position = projection_matrix * vec4(in_position, 1.0);
+    // Each instance is drawn as a 4 vertex triangle strip: (0, 0), (1, 0), (0, 1), (1, 1).
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+
+    gl_Position = projection_matrix * vec4(in_rect.xy + corner * in_rect.zw, in_layer, 1.0);
     vertex_color = in_color;
-    vertex_tex_coord = in_tex_coord;
+    vertex_tex_coord = in_uv_rect.xy + vec2(corner.x, 1.0 - corner.y) * in_uv_rect.zw;
 }
\ No newline at end of file
@@ -0,0 +1,503 @@
+// Headless benchmarks for the engine's core kernels. Every run uses the same seeds and world shapes, so results can be
+// compared between builds. Usage: cblock_bench [results.json]
+
+#include "../src/file.h"
+#include "../src/chunk.h"
+#include "../src/world.h"
+#include "../src/region.h"
+#include "../src/graphics/mesher.h"
+
+#include <cglm/struct.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define BENCH_MAX_RESULTS 32
+// Each benchmark repeats until it has run for at least this long, in seconds.
+const double bench_min_time = 0.25;
+const uint32_t bench_seed = 0x9e3779b9;
+// Scratch file for the region benchmarks, removed once they finish.
+char *bench_region_path = "bench_region.cbrg";
+// Written by benchmarks that read data only to time the reads.
+volatile uint64_t bench_voxel_sum;
+
+struct BenchResult {
+    const char *name;
+    const char *shape;
+    size_t iteration_count;
+    double ns_per_op;
+    double voxels_per_second;
+    double vertices_per_second;
+};
+
+struct BenchResults {
+    struct BenchResult results[BENCH_MAX_RESULTS];
+    size_t result_count;
+};
+
+// The terrain that a benchmark's world is generated with.
+enum BenchShape {
+    BENCH_SHAPE_FLAT,
+    // Uneven ground with caves carved out of it, which gives lighting and meshing much more surface to work on.
+    BENCH_SHAPE_ROUGH,
+    BENCH_SHAPE_COUNT,
+};
+
+const char *bench_shape_names[BENCH_SHAPE_COUNT] = {"flat", "rough"};
+
+double bench_get_time(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    return (double)counter.QuadPart / frequency.QuadPart;
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec / 1e9;
+#endif
+}
+
+// Xorshift, so every run generates the same worlds and queries.
+uint32_t bench_random(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+float bench_random_float(uint32_t *state, float min, float max) {
+    return min + (bench_random(state) / (float)UINT32_MAX) * (max - min);
+}
+
+void bench_shape_chunk(struct Chunk *chunk, enum BenchShape shape, uint32_t *random_state) {
+    if (shape != BENCH_SHAPE_ROUGH) {
+        return;
+    }
+
+    const int32_t ground_height = chunk_height / 2;
+
+    for (int32_t z = 0; z < CHUNK_SIZE; z++) {
+        for (int32_t x = 0; x < CHUNK_SIZE; x++) {
+            int32_t height = ground_height - 8 + bench_random(random_state) % 12;
+
+            for (int32_t y = ground_height; y > height; y--) {
+                chunk_set_block(chunk, x, y, z, 0);
+            }
+
+            chunk_set_block(chunk, x, height, z, 2);
+
+            for (int32_t y = ground_height - 48; y < height - 4; y++) {
+                if (bench_random(random_state) % 8 == 0) {
+                    chunk_set_block(chunk, x, y, z, 0);
+                }
+            }
+        }
+    }
+}
+
+// Create a world with the given shape and fully light it.
+struct World bench_create_world(enum BenchShape shape) {
+    struct World world = world_create(NULL, REGION_MODE_COMPRESSED);
+    uint32_t random_state = bench_seed;
+
+    for (size_t i = 0; i < world_length; i++) {
+        bench_shape_chunk(&world.chunks[i], shape, &random_state);
+    }
+
+    list_reset_struct_LightingUpdate(&world.lighting_updates);
+
+    for (size_t i = 0; i < world_length; i++) {
+        memset(world.chunks[i].lightmap, 0, chunk_length);
+        world_init_chunk_lighting(&world, &world.chunks[i]);
+    }
+
+    world_update_lighting(&world);
+
+    return world;
+}
+
+void bench_add_result(struct BenchResults *results, struct BenchResult result) {
+    assert(results->result_count < BENCH_MAX_RESULTS);
+    results->results[results->result_count++] = result;
+
+    printf("%-28s %-6s %10zu %14.1f %14.0f %14.0f\n", result.name, result.shape, result.iteration_count,
+        result.ns_per_op, result.voxels_per_second, result.vertices_per_second);
+}
+
+void bench_chunk_create(struct BenchResults *results) {
+    size_t iteration_count = 0;
+    double start_time = bench_get_time();
+    double elapsed_time;
+
+    do {
+        struct Chunk chunk = chunk_create(0, 0);
+        chunk_destroy(&chunk);
+        iteration_count++;
+        elapsed_time = bench_get_time() - start_time;
+    } while (elapsed_time < bench_min_time);
+
+    bench_add_result(results, (struct BenchResult){
+                                  .name = "chunk_create",
+                                  .shape = bench_shape_names[BENCH_SHAPE_FLAT],
+                                  .iteration_count = iteration_count,
+                                  .ns_per_op = elapsed_time * 1e9 / iteration_count,
+                                  .voxels_per_second = iteration_count * chunk_length / elapsed_time,
+                              });
+}
+
+// Light the whole world from scratch, which is what happens when a world is first loaded.
+void bench_lighting(struct BenchResults *results, struct World *world, enum BenchShape shape) {
+    size_t iteration_count = 0;
+    double elapsed_time = 0.0;
+
+    do {
+        for (size_t i = 0; i < world_length; i++) {
+            memset(world->chunks[i].lightmap, 0, chunk_length);
+        }
+
+        double start_time = bench_get_time();
+
+        for (size_t i = 0; i < world_length; i++) {
+            world_init_chunk_lighting(world, &world->chunks[i]);
+        }
+
+        world_update_lighting(world);
+
+        elapsed_time += bench_get_time() - start_time;
+        iteration_count++;
+    } while (elapsed_time < bench_min_time);
+
+    bench_add_result(results, (struct BenchResult){
+                                  .name = "world_update_lighting",
+                                  .shape = bench_shape_names[shape],
+                                  .iteration_count = iteration_count,
+                                  .ns_per_op = elapsed_time * 1e9 / iteration_count,
+                                  .voxels_per_second = iteration_count * world_length * chunk_length / elapsed_time,
+                              });
+}
+
+// Save and load every chunk of the world through a region file.
+void bench_region(struct BenchResults *results, struct World *world, enum BenchShape shape) {
+    remove(bench_region_path);
+
+    struct Region region;
+    if (!region_open(bench_region_path, 0, 0, REGION_MODE_COMPRESSED, &region)) {
+        return;
+    }
+
+    size_t save_iteration_count = 0;
+    double save_start_time = bench_get_time();
+    double save_elapsed_time;
+
+    do {
+        for (size_t i = 0; i < world_length; i++) {
+            region_save_chunk(&region, &world->chunks[i]);
+        }
+
+        save_iteration_count++;
+        save_elapsed_time = bench_get_time() - save_start_time;
+    } while (save_elapsed_time < bench_min_time);
+
+    size_t load_iteration_count = 0;
+    double load_start_time = bench_get_time();
+    double load_elapsed_time;
+
+    do {
+        for (size_t i = 0; i < world_length; i++) {
+            struct Chunk chunk;
+            if (region_load_chunk(&region, world->chunks[i].x, world->chunks[i].z, &chunk)) {
+                chunk_destroy(&chunk);
+            }
+        }
+
+        load_iteration_count++;
+        load_elapsed_time = bench_get_time() - load_start_time;
+    } while (load_elapsed_time < bench_min_time);
+
+    region_close(&region);
+    remove(bench_region_path);
+
+    bench_add_result(results, (struct BenchResult){
+                                  .name = "region_save_chunk",
+                                  .shape = bench_shape_names[shape],
+                                  .iteration_count = save_iteration_count,
+                                  .ns_per_op = save_elapsed_time * 1e9 / (save_iteration_count * world_length),
+                                  .voxels_per_second =
+                                      save_iteration_count * world_length * chunk_length / save_elapsed_time,
+                              });
+
+    bench_add_result(results, (struct BenchResult){
+                                  .name = "region_load_chunk",
+                                  .shape = bench_shape_names[shape],
+                                  .iteration_count = load_iteration_count,
+                                  .ns_per_op = load_elapsed_time * 1e9 / (load_iteration_count * world_length),
+                                  .voxels_per_second =
+                                      load_iteration_count * world_length * chunk_length / load_elapsed_time,
+                              });
+}
+
+// Load every chunk of the world from a mapped region file, which uses uncompressed chunks without copying them.
+void bench_region_mapped(struct BenchResults *results, struct World *world, enum BenchShape shape) {
+    remove(bench_region_path);
+
+    struct Region region;
+    if (!region_open(bench_region_path, 0, 0, REGION_MODE_UNCOMPRESSED, &region)) {
+        return;
+    }
+
+    for (size_t i = 0; i < world_length; i++) {
+        region_save_chunk(&region, &world->chunks[i]);
+    }
+
+    region_close(&region);
+
+    if (!region_open(bench_region_path, 0, 0, REGION_MODE_MAPPED, &region)) {
+        remove(bench_region_path);
+        return;
+    }
+
+    size_t iteration_count = 0;
+    // Loading a mapped chunk only points it at the mapping, so read every block and light level as a compressed load
+    // would. Otherwise nothing is read from the mapping and the voxel rate is meaningless.
+    uint64_t voxel_sum = 0;
+    double start_time = bench_get_time();
+    double elapsed_time;
+
+    do {
+        for (size_t i = 0; i < world_length; i++) {
+            struct Chunk chunk;
+            if (region_load_chunk(&region, world->chunks[i].x, world->chunks[i].z, &chunk)) {
+                for (size_t voxel_i = 0; voxel_i < chunk_length; voxel_i++) {
+                    voxel_sum += chunk.blocks[voxel_i] + chunk.lightmap[voxel_i];
+                }
+
+                chunk_destroy(&chunk);
+            }
+        }
+
+        iteration_count++;
+        elapsed_time = bench_get_time() - start_time;
+    } while (elapsed_time < bench_min_time);
+
+    region_close(&region);
+    remove(bench_region_path);
+
+    // Keep the sum so the reads aren't optimized away.
+    bench_voxel_sum = voxel_sum;
+
+    bench_add_result(results, (struct BenchResult){
+                                  .name = "region_load_chunk_mapped",
+                                  .shape = bench_shape_names[shape],
+                                  .iteration_count = iteration_count,
+                                  .ns_per_op = elapsed_time * 1e9 / (iteration_count * world_length),
+                                  .voxels_per_second = iteration_count * world_length * chunk_length / elapsed_time,
+                              });
+}
+
+void bench_mesher(struct BenchResults *results, struct World *world, enum BenchShape shape, int32_t lod) {
+    static const char *names[LOD_COUNT] = {
+        "mesher_mesh_chunk_lod0",
+        "mesher_mesh_chunk_lod1",
+        "mesher_mesh_chunk_lod2",
+        "mesher_mesh_chunk_lod3",
+    };
+
+    struct Mesher mesher = mesher_create();
+    // An inner chunk, so that every side has a neighbor.
+    struct Chunk *chunk = &world->chunks[CHUNK_INDEX(1, 1)];
+
+    size_t iteration_count = 0;
+    size_t vertex_count = 0;
+    double start_time = bench_get_time();
+    double elapsed_time;
+
+    do {
+        mesher_mesh_chunk(&mesher, world, chunk, lod, 16, 16);
+        vertex_count += mesher.vertices.length / vertex_component_count;
+        iteration_count++;
+        elapsed_time = bench_get_time() - start_time;
+    } while (elapsed_time < bench_min_time);
+
+    mesher_destroy(&mesher);
+
+    bench_add_result(results, (struct BenchResult){
+                                  .name = names[lod],
+                                  .shape = bench_shape_names[shape],
+                                  .iteration_count = iteration_count,
+                                  .ns_per_op = elapsed_time * 1e9 / iteration_count,
+                                  .voxels_per_second = iteration_count * chunk_length / elapsed_time,
+                                  .vertices_per_second = vertex_count / elapsed_time,
+                              });
+}
+
+void bench_raycast(struct BenchResults *results, struct World *world, enum BenchShape shape) {
+    const size_t ray_count = 4096;
+    const float range = 16.0f;
+    uint32_t random_state = bench_seed;
+    vec3s *starts = malloc(ray_count * sizeof(vec3s));
+    vec3s *directions = malloc(ray_count * sizeof(vec3s));
+    assert(starts);
+    assert(directions);
+
+    // Rays start just above the ground and look around it, like the player's camera does.
+    for (size_t i = 0; i < ray_count; i++) {
+        starts[i] = (vec3s){{
+            bench_random_float(&random_state, 0.0f, world_size_in_blocks),
+            bench_random_float(&random_state, chunk_height / 2 + 1.0f, chunk_height / 2 + 4.0f),
+            bench_random_float(&random_state, 0.0f, world_size_in_blocks),
+        }};
+        directions[i] = (vec3s){{
+            bench_random_float(&random_state, -1.0f, 1.0f),
+            bench_random_float(&random_state, -1.0f, 0.2f),
+            bench_random_float(&random_state, -1.0f, 1.0f),
+        }};
+    }
+
+    size_t iteration_count = 0;
+    size_t hit_count = 0;
+    double start_time = bench_get_time();
+    double elapsed_time;
+
+    do {
+        for (size_t i = 0; i < ray_count; i++) {
+            struct RaycastHit hit = world_raycast(world, starts[i], directions[i], range);
+            hit_count += hit.block != 0;
+        }
+
+        iteration_count += ray_count;
+        elapsed_time = bench_get_time() - start_time;
+    } while (elapsed_time < bench_min_time);
+
+    // Using the hits keeps the calls from being optimized out.
+    if (hit_count == 0) {
+        printf("No rays hit anything\n");
+    }
+
+    free(starts);
+    free(directions);
+
+    bench_add_result(results, (struct BenchResult){
+                                  .name = "world_raycast",
+                                  .shape = bench_shape_names[shape],
+                                  .iteration_count = iteration_count,
+                                  .ns_per_op = elapsed_time * 1e9 / iteration_count,
+                              });
+}
+
+void bench_collision(struct BenchResults *results, struct World *world, enum BenchShape shape) {
+    const size_t box_count = 4096;
+    const vec3s size = {{0.8f, 1.8f, 0.8f}};
+    const vec3s origin = {{0.0f, -0.9f, 0.0f}};
+    uint32_t random_state = bench_seed;
+    vec3s *positions = malloc(box_count * sizeof(vec3s));
+    assert(positions);
+
+    // Player sized boxes around the surface, where both colliding and free boxes are common.
+    for (size_t i = 0; i < box_count; i++) {
+        positions[i] = (vec3s){{
+            bench_random_float(&random_state, 0.0f, world_size_in_blocks),
+            bench_random_float(&random_state, chunk_height / 2 - 8.0f, chunk_height / 2 + 4.0f),
+            bench_random_float(&random_state, 0.0f, world_size_in_blocks),
+        }};
+    }
+
+    size_t iteration_count = 0;
+    size_t collision_count = 0;
+    double start_time = bench_get_time();
+    double elapsed_time;
+
+    do {
+        for (size_t i = 0; i < box_count; i++) {
+            collision_count += world_is_colliding_with_box(world, positions[i], size, origin);
+        }
+
+        iteration_count += box_count;
+        elapsed_time = bench_get_time() - start_time;
+    } while (elapsed_time < bench_min_time);
+
+    if (collision_count == 0) {
+        printf("No boxes collided\n");
+    }
+
+    free(positions);
+
+    bench_add_result(results, (struct BenchResult){
+                                  .name = "world_is_colliding_with_box",
+                                  .shape = bench_shape_names[shape],
+                                  .iteration_count = iteration_count,
+                                  .ns_per_op = elapsed_time * 1e9 / iteration_count,
+                              });
+}
+
+bool bench_write_results(struct BenchResults *results, char *file_path) {
+    FILE *file = file_open(file_path, "wb");
+
+    if (!file) {
+        return false;
+    }
+
+    fprintf(file, "{\n  \"results\": [\n");
+
+    for (size_t i = 0; i < results->result_count; i++) {
+        struct BenchResult *result = &results->results[i];
+        fprintf(file,
+            "    {\"name\": \"%s\", \"shape\": \"%s\", \"iterations\": %zu, \"ns_per_op\": %.3f, "
+            "\"voxels_per_second\": %.1f, \"vertices_per_second\": %.1f}%s\n",
+            result->name, result->shape, result->iteration_count, result->ns_per_op, result->voxels_per_second,
+            result->vertices_per_second, i + 1 < results->result_count ? "," : "");
+    }
+
+    fprintf(file, "  ]\n}\n");
+
+    return fclose(file) == 0;
+}
+
+int main(int argc, char **argv) {
+    char *results_path = argc > 1 ? argv[1] : "bench_results.json";
+    struct BenchResults results = (struct BenchResults){0};
+
+    printf("%-28s %-6s %10s %14s %14s %14s\n", "benchmark", "shape", "iterations", "ns/op", "voxels/s", "vertices/s");
+
+    bench_chunk_create(&results);
+
+    for (enum BenchShape shape = 0; shape < BENCH_SHAPE_COUNT; shape++) {
+        struct World world = bench_create_world(shape);
+
+        bench_lighting(&results, &world, shape);
+
+        for (int32_t lod = 0; lod < LOD_COUNT; lod++) {
+            bench_mesher(&results, &world, shape, lod);
+        }
+
+        bench_raycast(&results, &world, shape);
+        bench_collision(&results, &world, shape);
+        bench_region(&results, &world, shape);
+        bench_region_mapped(&results, &world, shape);
+
+        world_destroy(&world);
+    }
+
+    if (!bench_write_results(&results, results_path)) {
+        printf("Failed to write results: %s\n", results_path);
+        return -1;
+    }
+
+    printf("Wrote %s\n", results_path);
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include "asset_pack.h"
+
+#include "file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const char asset_pack_magic[4] = {'C', 'B', 'A', 'P'};
+
+// Check that the mapped file is a pack of this version, that its table of contents and entries are in bounds, and that
+// every entry is terminated by a zero byte.
+bool asset_pack_validate(const uint8_t *data, size_t length) {
+    struct AssetPackHeader header;
+    if (length < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, asset_pack_magic, sizeof(asset_pack_magic)) != 0 ||
+        header.version != ASSET_PACK_VERSION ||
+        header.entry_count > (length - sizeof(header)) / sizeof(struct AssetPackEntry)) {
+        return false;
+    }
+
+    const struct AssetPackEntry *entries = (const struct AssetPackEntry *)(data + sizeof(header));
+    for (uint32_t i = 0; i < header.entry_count; i++) {
+        if (entries[i].offset > length || entries[i].length >= length - entries[i].offset ||
+            data[entries[i].offset + entries[i].length] != '\0' ||
+            entries[i].name[ASSET_PACK_NAME_LENGTH - 1] != '\0') {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct AssetPack asset_pack_open(char *file_path) {
+    struct AssetPack asset_pack = (struct AssetPack){0};
+
+#ifdef _WIN32
+    HANDLE file_handle = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return asset_pack;
+    }
+
+    LARGE_INTEGER file_size;
+    HANDLE mapping_handle = NULL;
+    const uint8_t *data = NULL;
+
+    if (GetFileSizeEx(file_handle, &file_size) && file_size.QuadPart > 0) {
+        mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+
+    if (mapping_handle) {
+        data = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    }
+
+    if (!data || !asset_pack_validate(data, (size_t)file_size.QuadPart)) {
+        if (data) {
+            UnmapViewOfFile(data);
+        }
+
+        if (mapping_handle) {
+            CloseHandle(mapping_handle);
+        }
+
+        CloseHandle(file_handle);
+        printf("Asset pack is invalid: %s\n", file_path);
+        return asset_pack;
+    }
+
+    asset_pack.file_handle = file_handle;
+    asset_pack.mapping_handle = mapping_handle;
+    asset_pack.length = (size_t)file_size.QuadPart;
+#else
+    int file = open(file_path, O_RDONLY);
+    if (file == -1) {
+        return asset_pack;
+    }
+
+    struct stat file_stat;
+    const uint8_t *data = MAP_FAILED;
+
+    if (fstat(file, &file_stat) == 0 && file_stat.st_size > 0) {
+        data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    }
+
+    // The mapping keeps the file alive.
+    close(file);
+
+    if (data == MAP_FAILED || !asset_pack_validate(data, file_stat.st_size)) {
+        if (data != MAP_FAILED) {
+            munmap((void *)data, file_stat.st_size);
+        }
+
+        printf("Asset pack is invalid: %s\n", file_path);
+        return asset_pack;
+    }
+
+    // Everything in the pack is read once while starting, so let the kernel read ahead all of it.
+    madvise((void *)data, file_stat.st_size, MADV_WILLNEED);
+
+    asset_pack.length = file_stat.st_size;
+#endif
+
+    const struct AssetPackHeader *header = (const struct AssetPackHeader *)data;
+    asset_pack.data = data;
+    asset_pack.entries = (const struct AssetPackEntry *)(data + sizeof(struct AssetPackHeader));
+    asset_pack.entry_count = header->entry_count;
+
+    return asset_pack;
+}
+
+// Get a view of an entry's data, or NULL if there is no entry with the name. The view is valid until the pack closes.
+const void *asset_pack_find(const struct AssetPack *asset_pack, const char *name, size_t *length) {
+    size_t start = 0;
+    size_t end = asset_pack->entry_count;
+
+    while (start < end) {
+        size_t middle = start + (end - start) / 2;
+        const struct AssetPackEntry *entry = &asset_pack->entries[middle];
+        int comparison = strcmp(name, entry->name);
+
+        if (comparison == 0) {
+            *length = entry->length;
+            return asset_pack->data + entry->offset;
+        } else if (comparison < 0) {
+            end = middle;
+        } else {
+            start = middle + 1;
+        }
+    }
+
+    return NULL;
+}
+
+void asset_pack_close(struct AssetPack *asset_pack) {
+    if (!asset_pack->data) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(asset_pack->data);
+    CloseHandle(asset_pack->mapping_handle);
+    CloseHandle(asset_pack->file_handle);
+#else
+    munmap((void *)asset_pack->data, asset_pack->length);
+#endif
+
+    *asset_pack = (struct AssetPack){0};
+}
+
+// Load an asset from the pack if it contains one with this path, otherwise read the loose file.
+bool asset_load(const struct AssetPack *asset_pack, char *file_path, struct Asset *asset) {
+    size_t length;
+    const void *data = asset_pack_find(asset_pack, file_path, &length);
+
+    if (data) {
+        *asset = (struct Asset){
+            .data = data,
+            .length = length,
+        };
+        return true;
+    }
+
+    uint8_t *allocation = get_file_bytes(file_path, &length);
+    if (!allocation) {
+        return false;
+    }
+
+    *asset = (struct Asset){
+        .data = allocation,
+        .length = length,
+        .allocation = allocation,
+    };
+    return true;
+}
+
+void asset_destroy(struct Asset *asset) {
+    free(asset->allocation);
+}
@@ -0,0 +1,59 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include "detect_leak.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ASSET_PACK_VERSION 1
+#define ASSET_PACK_NAME_LENGTH 64
+// Entries start on cache line boundaries so that their contents can be used in place.
+#define ASSET_PACK_ALIGNMENT 64
+
+// An asset pack is this header, a table of contents sorted by name, and then the entries' data. Every entry is
+// followed by at least one zero byte, so text entries can be used as C strings.
+struct AssetPackHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t reserved;
+};
+
+struct AssetPackEntry {
+    char name[ASSET_PACK_NAME_LENGTH];
+    uint64_t offset;
+    uint64_t length;
+};
+
+// A read-only memory mapping of an asset pack. A pack that failed to open has no entries.
+struct AssetPack {
+    const uint8_t *data;
+    size_t length;
+    const struct AssetPackEntry *entries;
+    uint32_t entry_count;
+#ifdef _WIN32
+    void *file_handle;
+    void *mapping_handle;
+#endif
+};
+
+// The contents of an asset, either viewed from a pack or read from a loose file.
+struct Asset {
+    const uint8_t *data;
+    size_t length;
+    // Only set for assets read from loose files.
+    uint8_t *allocation;
+};
+
+extern const char asset_pack_magic[4];
+
+struct AssetPack asset_pack_open(char *file_path);
+const void *asset_pack_find(const struct AssetPack *asset_pack, const char *name, size_t *length);
+void asset_pack_close(struct AssetPack *asset_pack);
+
+bool asset_load(const struct AssetPack *asset_pack, char *file_path, struct Asset *asset);
+void asset_destroy(struct Asset *asset);
+
+#endif
@@ -2,6 +2,7 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 
 const size_t chunk_height = 256;
 const size_t chunk_length = CHUNK_SIZE * CHUNK_SIZE * chunk_height;
@@ -12,26 +13,50 @@ const uint8_t sunlight_mask = 0xf0; // Upper 4 bits are for sunlighting.
 const uint8_t light_offset = 0;
 const uint8_t sunlight_offset = 4;
 
-struct Chunk chunk_create(int32_t x, int32_t z) {
-    struct Chunk chunk = (struct Chunk){
+// Allocate a chunk of air with no generated terrain.
+struct Chunk chunk_create_empty(int32_t x, int32_t z) {
+    struct ChunkStorage *storage = malloc(sizeof(struct ChunkStorage));
+    assert(storage);
+
+    *storage = (struct ChunkStorage){
+        .reference_count = 1,
         .blocks = calloc(chunk_length, sizeof(uint8_t)),
         .lightmap = calloc(chunk_length, sizeof(uint8_t)),
-        .x = x,
-        .z = z,
         .heightmap_min = malloc(heightmap_length * sizeof(int32_t)),
         .heightmap_max = calloc(heightmap_length, sizeof(int32_t)),
-        .is_dirty = false,
     };
 
-    assert(chunk.blocks);
-    assert(chunk.lightmap);
-    assert(chunk.heightmap_min);
-    assert(chunk.heightmap_max);
+    assert(storage->blocks);
+    assert(storage->lightmap);
+    assert(storage->heightmap_min);
+    assert(storage->heightmap_max);
+
+    struct Chunk chunk = (struct Chunk){
+        .storage = storage,
+        .blocks = storage->blocks,
+        .lightmap = storage->lightmap,
+        .x = x,
+        .z = z,
+        .heightmap_min = storage->heightmap_min,
+        .heightmap_max = storage->heightmap_max,
+        .is_dirty = false,
+        .is_edited = false,
+        .generation = 0,
+        .saved_generation = 0,
+        .is_lightmap_valid = false,
+        .light_neighbor_generations = {0},
+    };
 
     for (size_t i = 0; i < heightmap_length; i++) {
         chunk.heightmap_min[i] = chunk_height - 1;
     }
 
+    return chunk;
+}
+
+struct Chunk chunk_create(int32_t x, int32_t z) {
+    struct Chunk chunk = chunk_create_empty(x, z);
+
     size_t ground_height = chunk_height / 2;
     for (size_t z = 0; z < CHUNK_SIZE; z++) {
         for (size_t x = 0; x < CHUNK_SIZE; x++) {
@@ -47,13 +72,93 @@ struct Chunk chunk_create(int32_t x, int32_t z) {
         }
     }
 
+    // Generated terrain can always be generated again, so only later block changes need to be saved.
+    chunk.saved_generation = chunk.generation;
+
     return chunk;
 }
 
+// Create a chunk that uses data in a read-only mapping, which must stay mapped until the chunk is destroyed. The data
+// is never written through these pointers.
+struct Chunk chunk_create_mapped(
+    int32_t x, int32_t z, uint8_t *blocks, uint8_t *lightmap, int32_t *heightmap_min, int32_t *heightmap_max) {
+    return (struct Chunk){
+        .storage = NULL,
+        .blocks = blocks,
+        .lightmap = lightmap,
+        .x = x,
+        .z = z,
+        .heightmap_min = heightmap_min,
+        .heightmap_max = heightmap_max,
+        .is_dirty = false,
+        .is_edited = false,
+        .generation = 0,
+        .saved_generation = 0,
+        .is_lightmap_valid = false,
+        .light_neighbor_generations = {0},
+    };
+}
+
+// Copy a chunk's blocks, lighting, heightmaps and generation into a new chunk.
+struct Chunk chunk_clone(struct Chunk *chunk) {
+    struct Chunk clone = chunk_create_empty(chunk->x, chunk->z);
+    clone.generation = chunk->generation;
+    clone.saved_generation = chunk->saved_generation;
+
+    memcpy(clone.blocks, chunk->blocks, chunk_length * sizeof(uint8_t));
+    memcpy(clone.lightmap, chunk->lightmap, chunk_length * sizeof(uint8_t));
+    memcpy(clone.heightmap_min, chunk->heightmap_min, heightmap_length * sizeof(int32_t));
+    memcpy(clone.heightmap_max, chunk->heightmap_max, heightmap_length * sizeof(int32_t));
+
+    return clone;
+}
+
+// Share a chunk's data with a copy that won't see any of the chunk's later changes. Nothing is copied until the chunk
+// is next written to, and then only if the snapshot still exists. Destroy the snapshot like any other chunk, it can be
+// destroyed on another thread. Snapshots of a mapped chunk must not outlive the mapping.
+struct Chunk chunk_snapshot(struct Chunk *chunk) {
+    if (chunk->storage) {
+        atomic_fetch_add_explicit(&chunk->storage->reference_count, 1, memory_order_relaxed);
+    }
+
+    return *chunk;
+}
+
+static void chunk_release_storage(struct ChunkStorage *storage) {
+    if (!storage || atomic_fetch_sub_explicit(&storage->reference_count, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    free(storage->blocks);
+    free(storage->lightmap);
+    free(storage->heightmap_min);
+    free(storage->heightmap_max);
+    free(storage);
+}
+
+// Give a chunk its own copy of its data if the data is mapped or shared with a snapshot, so that it can be written to.
+void chunk_make_writable(struct Chunk *chunk) {
+    if (chunk_is_writable(chunk)) {
+        return;
+    }
+
+    struct Chunk clone = chunk_clone(chunk);
+    chunk_release_storage(chunk->storage);
+
+    chunk->storage = clone.storage;
+    chunk->blocks = clone.blocks;
+    chunk->lightmap = clone.lightmap;
+    chunk->heightmap_min = clone.heightmap_min;
+    chunk->heightmap_max = clone.heightmap_max;
+}
+
 void chunk_set_block(struct Chunk *chunk, int32_t x, int32_t y, int32_t z, uint8_t block) {
+    chunk_make_writable(chunk);
+
     size_t i = BLOCK_INDEX(x, y, z);
     chunk->blocks[i] = block;
     chunk->is_dirty = true;
+    ++chunk->generation;
 
     int32_t heightmap_i = HEIGHTMAP_INDEX(x, z);
     int32_t *heightmap_block_min = chunk->heightmap_min + heightmap_i;
@@ -85,12 +190,10 @@ void chunk_set_block(struct Chunk *chunk, int32_t x, int32_t y, int32_t z, uint8
 }
 
 void chunk_destroy(struct Chunk *chunk) {
-    free(chunk->blocks);
-    free(chunk->lightmap);
-    free(chunk->heightmap_min);
-    free(chunk->heightmap_max);
+    chunk_release_storage(chunk->storage);
 }
 
+extern inline bool chunk_is_writable(struct Chunk *chunk);
 extern inline uint8_t chunk_get_block(struct Chunk *chunk, int32_t x, int32_t y, int32_t z);
 extern inline uint8_t chunk_get_light_level(struct Chunk *chunk, int32_t x, int32_t y, int32_t z, uint8_t mask, uint8_t offset);
 extern inline void chunk_set_light_level(struct Chunk *chunk, int32_t x, int32_t y, int32_t z, uint8_t light_level, uint8_t mask, uint8_t offset);
\ No newline at end of file
@@ -4,11 +4,15 @@
 #include "detect_leak.h"
 
 #include <inttypes.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 
 #define CHUNK_SIZE 16
+// Chunks are split vertically into cubic sections of CHUNK_SIZE blocks, this must equal chunk_height / CHUNK_SIZE.
+#define CHUNK_SECTION_COUNT 16
 extern const size_t chunk_height;
 extern const size_t chunk_length;
+extern const size_t heightmap_length;
 #define MAX_LIGHT_LEVEL 15
 extern const float inv_light_level_count;
 extern const uint8_t light_mask;
@@ -16,7 +20,28 @@ extern const uint8_t sunlight_mask;
 extern const uint8_t light_offset;
 extern const uint8_t sunlight_offset;
 
+// The chunks sharing a side with a chunk.
+enum ChunkNeighbor {
+    CHUNK_NEIGHBOR_NEGATIVE_X,
+    CHUNK_NEIGHBOR_POSITIVE_X,
+    CHUNK_NEIGHBOR_NEGATIVE_Z,
+    CHUNK_NEIGHBOR_POSITIVE_Z,
+    CHUNK_NEIGHBOR_COUNT,
+};
+
+// A chunk's blocks, lightmap and heightmaps, shared by the chunk and its snapshots. Freed along with the last of them.
+struct ChunkStorage {
+    _Atomic(size_t) reference_count;
+    uint8_t *blocks;
+    uint8_t *lightmap;
+    int32_t *heightmap_min;
+    int32_t *heightmap_max;
+};
+
 struct Chunk {
+    // Holds blocks, lightmap and the heightmaps, or NULL if they point into a read-only mapping of a region file. They
+    // can only be written to while no snapshot shares them, otherwise they're copied the first time the chunk changes.
+    struct ChunkStorage *storage;
     uint8_t *blocks;
     uint8_t *lightmap;
     uint32_t x;
@@ -24,15 +49,37 @@ struct Chunk {
     int32_t *heightmap_min;
     int32_t *heightmap_max;
     bool is_dirty;
+    // Set when a player edit caused the pending remesh, these chunks are meshed before any others.
+    bool is_edited;
+    // Bumped by every block change, unlike is_dirty lighting doesn't change it. The chunk has changes that haven't been
+    // saved while it differs from saved_generation.
+    uint32_t generation;
+    uint32_t saved_generation;
+    // Only used by chunks being saved or loaded. The lightmap is valid if it was fully lit against the chunk's blocks
+    // and against neighbors with these generations, light along the side of a neighbor that changed since may be stale.
+    bool is_lightmap_valid;
+    uint32_t light_neighbor_generations[CHUNK_NEIGHBOR_COUNT];
 };
 
 #define BLOCK_INDEX(x, y, z) ((y) + (x)*chunk_height + (z)*chunk_height * CHUNK_SIZE)
 #define HEIGHTMAP_INDEX(x, z) ((x) + (z)*CHUNK_SIZE)
 
+struct Chunk chunk_create_empty(int32_t x, int32_t z);
 struct Chunk chunk_create(int32_t x, int32_t z);
+struct Chunk chunk_create_mapped(
+    int32_t x, int32_t z, uint8_t *blocks, uint8_t *lightmap, int32_t *heightmap_min, int32_t *heightmap_max);
+struct Chunk chunk_clone(struct Chunk *chunk);
+struct Chunk chunk_snapshot(struct Chunk *chunk);
+void chunk_make_writable(struct Chunk *chunk);
 void chunk_set_block(struct Chunk *chunk, int32_t x, int32_t y, int32_t z, uint8_t block);
 void chunk_destroy(struct Chunk *chunk);
 
+// Whether the chunk's data is its own and not shared with a snapshot. Snapshots destroyed on other threads can only
+// make this true, so once it's true it stays true until the chunk's owner takes another snapshot.
+inline bool chunk_is_writable(struct Chunk *chunk) {
+    return chunk->storage && atomic_load_explicit(&chunk->storage->reference_count, memory_order_acquire) == 1;
+}
+
 inline uint8_t chunk_get_block(struct Chunk *chunk, int32_t x, int32_t y, int32_t z) {
     size_t i = BLOCK_INDEX(x, y, z);
     return chunk->blocks[i];
@@ -45,7 +92,18 @@ inline uint8_t chunk_get_light_level(struct Chunk *chunk, int32_t x, int32_t y,
 
 inline void chunk_set_light_level(struct Chunk *chunk, int32_t x, int32_t y, int32_t z, uint8_t light_level, uint8_t mask, uint8_t offset) {
     size_t i = BLOCK_INDEX(x, y, z);
-    chunk->lightmap[i] = (chunk->lightmap[i] & ~mask) | (light_level << offset);
+    uint8_t light = (chunk->lightmap[i] & ~mask) | (light_level << offset);
+
+    // Relighting often writes the levels a chunk already has, which shouldn't cost a mapped or shared chunk a copy.
+    if (!chunk_is_writable(chunk)) {
+        if (chunk->lightmap[i] == light) {
+            return;
+        }
+
+        chunk_make_writable(chunk);
+    }
+
+    chunk->lightmap[i] = light;
 }
 
 #endif
\ No newline at end of file
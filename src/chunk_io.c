@@ -0,0 +1,450 @@
+#include "chunk_io.h"
+#include "file.h"
+#include "trace.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Must be a power of two, the I/O thread waits for the world to take completions if it fills up.
+const size_t chunk_io_completion_capacity = 64;
+// Neighbouring records are merged into one read or write until it reaches this many sectors.
+const size_t chunk_io_max_run_sector_count = 256;
+
+static void chunk_io_reserve(uint8_t **buffer, size_t *capacity, size_t length) {
+    if (length <= *capacity) {
+        return;
+    }
+
+    while (*capacity < length) {
+        *capacity *= 2;
+    }
+
+    *buffer = realloc(*buffer, *capacity);
+    assert(*buffer);
+}
+
+static int chunk_io_span_compare(const void *a, const void *b) {
+    const struct ChunkIoSpan *span_a = a;
+    const struct ChunkIoSpan *span_b = b;
+
+    if (span_a->first_sector != span_b->first_sector) {
+        return span_a->first_sector < span_b->first_sector ? -1 : 1;
+    }
+
+    return 0;
+}
+
+// Find how many spans starting at span_i are in neighbouring sectors and can be handled with one call.
+static size_t chunk_io_get_run_length(struct ChunkIo *io, size_t span_i, size_t *run_sector_count) {
+    struct ChunkIoSpan *spans = io->spans.data;
+    size_t span_count = 1;
+    *run_sector_count = spans[span_i].sector_count;
+
+    while (span_i + span_count < io->spans.length) {
+        struct ChunkIoSpan *previous = &spans[span_i + span_count - 1];
+        struct ChunkIoSpan *next = &spans[span_i + span_count];
+
+        if (next->first_sector != previous->first_sector + previous->sector_count ||
+            *run_sector_count + next->sector_count > chunk_io_max_run_sector_count) {
+            break;
+        }
+
+        *run_sector_count += next->sector_count;
+        ++span_count;
+    }
+
+    return span_count;
+}
+
+// Wait for the world to make space if the completion queue is full, unless nothing will take the completion anymore.
+static void chunk_io_complete(struct ChunkIo *io, struct ChunkIoCompletion completion) {
+    mutex_lock(io->mutex);
+
+    while (!queue_push_struct_ChunkIoCompletion(&io->completions, completion)) {
+        if (io->is_done) {
+            mutex_unlock(io->mutex);
+
+            if (completion.is_loaded) {
+                chunk_destroy(&completion.chunk);
+            }
+
+            return;
+        }
+
+        condition_wait(io->completion_condition, io->mutex);
+    }
+
+    condition_signal(io->completion_condition);
+    mutex_unlock(io->mutex);
+}
+
+static void chunk_io_save_batch(struct ChunkIo *io) {
+    struct List_struct_ChunkIoRequest *batch = &io->batch;
+    size_t record_capacity = region_get_record_capacity();
+
+    list_reset_struct_ChunkIoSpan(&io->spans);
+    memset(io->is_chunk_in_batch, 0, REGION_CHUNK_COUNT * sizeof(bool));
+
+    size_t first_chunk_i = REGION_CHUNK_COUNT;
+    size_t last_chunk_i = 0;
+    size_t records_length = 0;
+
+    // Only the newest save of each chunk is written, so walk the batch backwards.
+    for (size_t i = batch->length; i-- > 0;) {
+        struct ChunkIoRequest *request = &batch->data[i];
+
+        if (request->type != CHUNK_IO_SAVE) {
+            continue;
+        }
+
+        size_t chunk_i = region_get_chunk_index(request->x, request->z);
+
+        if (!io->is_chunk_in_batch[chunk_i]) {
+            io->is_chunk_in_batch[chunk_i] = true;
+            first_chunk_i = chunk_i < first_chunk_i ? chunk_i : first_chunk_i;
+            last_chunk_i = chunk_i > last_chunk_i ? chunk_i : last_chunk_i;
+
+            chunk_io_reserve(&io->records, &io->records_capacity, records_length + record_capacity);
+
+            uint32_t old_chunk_sectors = io->region.header.chunk_sectors[chunk_i];
+            size_t sector_count = region_encode_chunk(&io->region, &request->chunk, io->records + records_length);
+            size_t first_sector = region_place_chunk(&io->region, request->x, request->z, sector_count);
+
+            list_push_struct_ChunkIoSpan(&io->spans, (struct ChunkIoSpan){
+                                                         .x = request->x,
+                                                         .z = request->z,
+                                                         .first_sector = first_sector,
+                                                         .sector_count = sector_count,
+                                                         .buffer_offset = records_length,
+                                                         .old_chunk_sectors = old_chunk_sectors,
+                                                         .is_written = true,
+                                                         .generation = request->chunk.generation,
+                                                         .saved_generation = request->chunk.saved_generation,
+                                                     });
+
+            records_length += sector_count * REGION_SECTOR_SIZE;
+        }
+
+        chunk_destroy(&request->chunk);
+    }
+
+    if (io->spans.length == 0) {
+        return;
+    }
+
+    TRACE_BEGIN("chunk_io_save_batch");
+
+    qsort(io->spans.data, io->spans.length, sizeof(struct ChunkIoSpan), chunk_io_span_compare);
+
+    // Gather the records of neighbouring sectors into one buffer so they're written together.
+    for (size_t span_i = 0; span_i < io->spans.length;) {
+        size_t run_sector_count;
+        size_t span_count = chunk_io_get_run_length(io, span_i, &run_sector_count);
+
+        chunk_io_reserve(&io->buffer, &io->buffer_capacity, run_sector_count * REGION_SECTOR_SIZE);
+
+        size_t buffer_length = 0;
+        for (size_t i = span_i; i < span_i + span_count; i++) {
+            struct ChunkIoSpan *span = &io->spans.data[i];
+            size_t record_length = span->sector_count * REGION_SECTOR_SIZE;
+            memcpy(io->buffer + buffer_length, io->records + span->buffer_offset, record_length);
+            buffer_length += record_length;
+        }
+
+        // The chunks go back to their old records, which are still intact unless they were being rewritten in place.
+        if (!file_write_at(io->region.file, io->spans.data[span_i].first_sector * REGION_SECTOR_SIZE, io->buffer,
+                buffer_length)) {
+            printf("Failed to write %zu chunks\n", span_count);
+
+            for (size_t i = span_i; i < span_i + span_count; i++) {
+                struct ChunkIoSpan *span = &io->spans.data[i];
+                size_t chunk_i = region_get_chunk_index(span->x, span->z);
+
+                region_release_sectors(&io->region, io->region.header.chunk_sectors[chunk_i], span->old_chunk_sectors);
+                io->region.header.chunk_sectors[chunk_i] = span->old_chunk_sectors;
+                span->is_written = false;
+            }
+        }
+
+        span_i += span_count;
+    }
+
+    // Sectors that records moved out of can only be reused once the table no longer points at them. If the table
+    // couldn't be written they stay reserved until the region is opened again.
+    bool is_table_written = region_write_chunk_sectors(&io->region, first_chunk_i, last_chunk_i - first_chunk_i + 1);
+    if (!is_table_written) {
+        printf("Failed to write the region's chunk table\n");
+    }
+
+    // Chunks that failed to save are reported so the world saves them again.
+    for (size_t i = 0; i < io->spans.length; i++) {
+        struct ChunkIoSpan *span = &io->spans.data[i];
+
+        if (is_table_written && span->is_written) {
+            uint32_t chunk_sectors = io->region.header.chunk_sectors[region_get_chunk_index(span->x, span->z)];
+            region_release_sectors(&io->region, span->old_chunk_sectors, chunk_sectors);
+        } else {
+            chunk_io_complete(io, (struct ChunkIoCompletion){
+                                      .type = CHUNK_IO_SAVE,
+                                      .x = span->x,
+                                      .z = span->z,
+                                      .generation = span->generation,
+                                      .saved_generation = span->saved_generation,
+                                  });
+        }
+    }
+
+    TRACE_COUNTER("chunk_io_saved_chunks", io->spans.length);
+    TRACE_END("chunk_io_save_batch");
+}
+
+static void chunk_io_load_batch(struct ChunkIo *io) {
+    struct List_struct_ChunkIoRequest *batch = &io->batch;
+
+    list_reset_struct_ChunkIoSpan(&io->spans);
+    memset(io->is_chunk_in_batch, 0, REGION_CHUNK_COUNT * sizeof(bool));
+
+    for (size_t i = 0; i < batch->length; i++) {
+        struct ChunkIoRequest *request = &batch->data[i];
+
+        if (request->type != CHUNK_IO_LOAD) {
+            continue;
+        }
+
+        size_t chunk_i = region_get_chunk_index(request->x, request->z);
+
+        if (io->is_chunk_in_batch[chunk_i]) {
+            continue;
+        }
+
+        io->is_chunk_in_batch[chunk_i] = true;
+
+        uint32_t chunk_sectors = io->region.header.chunk_sectors[chunk_i];
+
+        if (REGION_SECTOR_COUNT(chunk_sectors) == 0) {
+            chunk_io_complete(io, (struct ChunkIoCompletion){
+                                      .type = CHUNK_IO_LOAD,
+                                      .x = request->x,
+                                      .z = request->z,
+                                      .is_loaded = false,
+                                  });
+            continue;
+        }
+
+        list_push_struct_ChunkIoSpan(&io->spans, (struct ChunkIoSpan){
+                                                     .x = request->x,
+                                                     .z = request->z,
+                                                     .first_sector = REGION_FIRST_SECTOR(chunk_sectors),
+                                                     .sector_count = REGION_SECTOR_COUNT(chunk_sectors),
+                                                 });
+    }
+
+    if (io->spans.length == 0) {
+        return;
+    }
+
+    TRACE_BEGIN("chunk_io_load_batch");
+
+    qsort(io->spans.data, io->spans.length, sizeof(struct ChunkIoSpan), chunk_io_span_compare);
+
+    // Read the records of neighbouring sectors with one call, then decode them one at a time.
+    for (size_t span_i = 0; span_i < io->spans.length;) {
+        size_t run_sector_count;
+        size_t span_count = chunk_io_get_run_length(io, span_i, &run_sector_count);
+
+        size_t run_offset = io->spans.data[span_i].first_sector * REGION_SECTOR_SIZE;
+        const uint8_t *records = io->region.mapping + run_offset;
+        bool is_read = true;
+
+        // A mapped region's records are decoded where they are, so only the pages a chunk touches are ever read.
+        if (!io->region.mapping) {
+            chunk_io_reserve(&io->buffer, &io->buffer_capacity, run_sector_count * REGION_SECTOR_SIZE);
+            is_read = file_read_at(io->region.file, run_offset, io->buffer, run_sector_count * REGION_SECTOR_SIZE);
+            records = io->buffer;
+        }
+
+        size_t buffer_offset = 0;
+        for (size_t i = span_i; i < span_i + span_count; i++) {
+            struct ChunkIoSpan *span = &io->spans.data[i];
+            size_t record_length = span->sector_count * REGION_SECTOR_SIZE;
+            struct ChunkIoCompletion completion =
+                (struct ChunkIoCompletion){.type = CHUNK_IO_LOAD, .x = span->x, .z = span->z};
+
+            completion.is_loaded = is_read && region_decode_chunk(&io->region, records + buffer_offset, record_length,
+                                                  span->x, span->z, &completion.chunk);
+
+            chunk_io_complete(io, completion);
+            buffer_offset += record_length;
+        }
+
+        span_i += span_count;
+    }
+
+    TRACE_COUNTER("chunk_io_loaded_chunks", io->spans.length);
+    TRACE_END("chunk_io_load_batch");
+}
+
+static void chunk_io_thread_start(void *argument) {
+    struct ChunkIo *io = argument;
+    TRACE_THREAD_NAME("chunk_io");
+
+    while (true) {
+        mutex_lock(io->mutex);
+
+        while (io->requests.length == 0 && !io->is_done) {
+            condition_wait(io->condition, io->mutex);
+        }
+
+        // Requests are always finished before stopping, so that no saves are lost.
+        if (io->requests.length == 0) {
+            mutex_unlock(io->mutex);
+            break;
+        }
+
+        // Take every pending request as one batch by swapping lists.
+        struct List_struct_ChunkIoRequest batch = io->requests;
+        io->requests = io->batch;
+        io->batch = batch;
+
+        mutex_unlock(io->mutex);
+
+        // Saves go first so that a load in the same batch reads the newest data.
+        chunk_io_save_batch(io);
+        chunk_io_load_batch(io);
+
+        list_reset_struct_ChunkIoRequest(&io->batch);
+    }
+}
+
+// Returns NULL if the region file couldn't be opened or created.
+struct ChunkIo *chunk_io_create(char *region_path, enum RegionMode region_mode) {
+    struct ChunkIo *io = malloc(sizeof(struct ChunkIo));
+    assert(io);
+
+    // The whole world fits in the first region.
+    if (!region_open(region_path, 0, 0, region_mode, &io->region)) {
+        free(io);
+        return NULL;
+    }
+
+    io->mutex = mutex_create();
+    io->condition = condition_create();
+    io->completion_condition = condition_create();
+    io->requests = list_create_struct_ChunkIoRequest(64);
+    io->is_done = false;
+    io->batch = list_create_struct_ChunkIoRequest(64);
+    io->spans = list_create_struct_ChunkIoSpan(64);
+    io->is_chunk_in_batch = malloc(REGION_CHUNK_COUNT * sizeof(bool));
+    io->records_capacity = region_get_record_capacity();
+    io->records = malloc(io->records_capacity);
+    io->buffer_capacity = chunk_io_max_run_sector_count * REGION_SECTOR_SIZE;
+    io->buffer = malloc(io->buffer_capacity);
+    io->completions = queue_create_struct_ChunkIoCompletion(chunk_io_completion_capacity);
+
+    assert(io->mutex);
+    assert(io->condition);
+    assert(io->completion_condition);
+    assert(io->is_chunk_in_batch);
+    assert(io->records);
+    assert(io->buffer);
+
+    io->thread = thread_create(chunk_io_thread_start, io);
+    assert(io->thread);
+
+    return io;
+}
+
+// Requests are held until chunk_io_submit, so that a group of them is handled as one batch.
+void chunk_io_request_load(struct ChunkIo *io, int32_t x, int32_t z) {
+    mutex_lock(io->mutex);
+    list_push_struct_ChunkIoRequest(&io->requests, (struct ChunkIoRequest){.type = CHUNK_IO_LOAD, .x = x, .z = z});
+    mutex_unlock(io->mutex);
+}
+
+// The I/O thread takes ownership of the chunk, pass it a copy of any chunk that's still in use. A mapped region is
+// read-only, so the chunk is destroyed without being saved.
+void chunk_io_request_save(struct ChunkIo *io, struct Chunk chunk) {
+    if (io->region.mode == REGION_MODE_MAPPED) {
+        chunk_destroy(&chunk);
+        return;
+    }
+
+    mutex_lock(io->mutex);
+    list_push_struct_ChunkIoRequest(&io->requests, (struct ChunkIoRequest){
+                                                       .type = CHUNK_IO_SAVE,
+                                                       .x = chunk.x,
+                                                       .z = chunk.z,
+                                                       .chunk = chunk,
+                                                   });
+    mutex_unlock(io->mutex);
+}
+
+// Start reading a chunk that will be loaded soon, only mapped regions are read ahead. Unlike the requests, this reads
+// the chunk's pages on the calling thread's behalf without waiting for them.
+void chunk_io_prefetch(struct ChunkIo *io, int32_t x, int32_t z) {
+    region_prefetch_chunk(&io->region, x, z);
+}
+
+void chunk_io_submit(struct ChunkIo *io) {
+    mutex_lock(io->mutex);
+    condition_signal(io->condition);
+    mutex_unlock(io->mutex);
+}
+
+// Only call this from one thread. The caller takes ownership of any loaded chunk.
+bool chunk_io_pop_completion(struct ChunkIo *io, struct ChunkIoCompletion *completion) {
+    if (!queue_pop_struct_ChunkIoCompletion(&io->completions, completion)) {
+        return false;
+    }
+
+    // The I/O thread may be waiting for space in the queue.
+    mutex_lock(io->mutex);
+    condition_signal(io->completion_condition);
+    mutex_unlock(io->mutex);
+
+    return true;
+}
+
+// Block until there's a completion to pop, only call this from the thread that pops them.
+void chunk_io_wait_for_completion(struct ChunkIo *io) {
+    mutex_lock(io->mutex);
+
+    while (queue_is_empty_struct_ChunkIoCompletion(&io->completions) && !io->is_done) {
+        condition_wait(io->completion_condition, io->mutex);
+    }
+
+    mutex_unlock(io->mutex);
+}
+
+// Waits for every request to finish, loaded chunks that were never taken are destroyed.
+void chunk_io_destroy(struct ChunkIo *io) {
+    mutex_lock(io->mutex);
+    io->is_done = true;
+    condition_signal(io->condition);
+    condition_signal(io->completion_condition);
+    mutex_unlock(io->mutex);
+
+    thread_join(io->thread);
+
+    struct ChunkIoCompletion completion;
+    while (chunk_io_pop_completion(io, &completion)) {
+        if (completion.is_loaded) {
+            chunk_destroy(&completion.chunk);
+        }
+    }
+
+    region_close(&io->region);
+    mutex_destroy(io->mutex);
+    condition_destroy(io->condition);
+    condition_destroy(io->completion_condition);
+    list_destroy_struct_ChunkIoRequest(&io->requests);
+    list_destroy_struct_ChunkIoRequest(&io->batch);
+    list_destroy_struct_ChunkIoSpan(&io->spans);
+    free(io->is_chunk_in_batch);
+    free(io->records);
+    free(io->buffer);
+    queue_destroy_struct_ChunkIoCompletion(&io->completions);
+    free(io);
+}
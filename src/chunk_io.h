@@ -0,0 +1,100 @@
+#ifndef CHUNK_IO_H
+#define CHUNK_IO_H
+
+#include "detect_leak.h"
+
+#include "chunk.h"
+#include "list.h"
+#include "queue.h"
+#include "region.h"
+#include "thread.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+enum ChunkIoRequestType {
+    CHUNK_IO_LOAD,
+    CHUNK_IO_SAVE,
+};
+
+struct ChunkIoRequest {
+    enum ChunkIoRequestType type;
+    // Chunk coordinates in blocks, like the ones given to chunk_create.
+    int32_t x;
+    int32_t z;
+    // A copy of the chunk to save, owned by the request.
+    struct Chunk chunk;
+};
+
+typedef struct ChunkIoRequest struct_ChunkIoRequest;
+LIST_DEFINE(struct_ChunkIoRequest)
+
+// A chunk's sectors in the region file and where its record is in the I/O thread's buffer.
+struct ChunkIoSpan {
+    int32_t x;
+    int32_t z;
+    size_t first_sector;
+    size_t sector_count;
+    size_t buffer_offset;
+    // Only used by saves, the chunk's table entry from before it was saved and whether its record was written.
+    uint32_t old_chunk_sectors;
+    bool is_written;
+    // Only used by saves, reported back if the save fails.
+    uint32_t generation;
+    uint32_t saved_generation;
+};
+
+typedef struct ChunkIoSpan struct_ChunkIoSpan;
+LIST_DEFINE(struct_ChunkIoSpan)
+
+// A finished load or a save that couldn't be written, successful saves aren't reported.
+struct ChunkIoCompletion {
+    enum ChunkIoRequestType type;
+    int32_t x;
+    int32_t z;
+    // Only used by loads, false if the chunk hasn't been saved or couldn't be read and should be generated.
+    bool is_loaded;
+    struct Chunk chunk;
+    // Only used by saves, the generation that failed to save and the saved_generation of the chunk it was saved from.
+    uint32_t generation;
+    uint32_t saved_generation;
+};
+
+typedef struct ChunkIoCompletion struct_ChunkIoCompletion;
+QUEUE_DEFINE(struct_ChunkIoCompletion)
+
+// Loads and saves chunks on its own thread so that disk latency never blocks the frame or the meshing thread. Requests
+// that build up while the thread is busy are handled as one batch: records in neighbouring sectors are read and written
+// with a single call, and the chunk table is written once per batch.
+struct ChunkIo {
+    struct Region region;
+    struct Thread *thread;
+    // Guards the requests and is_done, the condition is signalled when either changes.
+    struct Mutex *mutex;
+    struct Condition *condition;
+    // Signalled with the mutex held when a completion is pushed or popped, or when is_done is set.
+    struct Condition *completion_condition;
+    struct List_struct_ChunkIoRequest requests;
+    bool is_done;
+    // Only used by the I/O thread.
+    struct List_struct_ChunkIoRequest batch;
+    struct List_struct_ChunkIoSpan spans;
+    bool *is_chunk_in_batch;
+    uint8_t *records;
+    size_t records_capacity;
+    uint8_t *buffer;
+    size_t buffer_capacity;
+    // Pushed by the I/O thread and popped by the thread that owns the world.
+    struct Queue_struct_ChunkIoCompletion completions;
+};
+
+struct ChunkIo *chunk_io_create(char *region_path, enum RegionMode region_mode);
+void chunk_io_request_load(struct ChunkIo *io, int32_t x, int32_t z);
+void chunk_io_request_save(struct ChunkIo *io, struct Chunk chunk);
+void chunk_io_prefetch(struct ChunkIo *io, int32_t x, int32_t z);
+void chunk_io_submit(struct ChunkIo *io);
+bool chunk_io_pop_completion(struct ChunkIo *io, struct ChunkIoCompletion *completion);
+void chunk_io_wait_for_completion(struct ChunkIo *io);
+void chunk_io_destroy(struct ChunkIo *io);
+
+#endif
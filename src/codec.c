@@ -0,0 +1,226 @@
+#include "codec.h"
+
+#include <string.h>
+
+// The LZ stream is a series of sequences in the style of LZ4. Each starts with a token whose high nibble is the literal
+// count and low nibble the match length minus LZ_MIN_MATCH, a nibble of 15 means more length bytes follow. The
+// literals come next, then a 2 byte little endian match offset. The last sequence is only literals.
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+size_t codec_rle_bound(size_t length) {
+    return length * 2;
+}
+
+size_t codec_rle_encode(const uint8_t *source, size_t length, size_t column_length, uint8_t *destination) {
+    uint8_t *output = destination;
+
+    for (size_t column_start = 0; column_start < length; column_start += column_length) {
+        size_t column_end = column_start + column_length;
+        if (column_end > length) {
+            column_end = length;
+        }
+
+        size_t i = column_start;
+        while (i < column_end) {
+            uint8_t value = source[i];
+            size_t run_length = 1;
+
+            while (i + run_length < column_end && run_length < 256 && source[i + run_length] == value) {
+                ++run_length;
+            }
+
+            output[0] = (uint8_t)(run_length - 1);
+            output[1] = value;
+            output += 2;
+            i += run_length;
+        }
+    }
+
+    return output - destination;
+}
+
+size_t codec_rle_decode(const uint8_t *source, size_t source_length, uint8_t *destination, size_t destination_length) {
+    size_t source_i = 0;
+    size_t destination_i = 0;
+
+    while (destination_i < destination_length) {
+        if (source_length - source_i < 2) {
+            return 0;
+        }
+
+        size_t run_length = (size_t)source[source_i] + 1;
+        if (run_length > destination_length - destination_i) {
+            return 0;
+        }
+
+        memset(destination + destination_i, source[source_i + 1], run_length);
+        source_i += 2;
+        destination_i += run_length;
+    }
+
+    return source_i;
+}
+
+size_t codec_lz_bound(size_t length) {
+    return length + length / 255 + 16;
+}
+
+static uint32_t lz_read_32(const uint8_t *source) {
+    uint32_t value;
+    memcpy(&value, source, sizeof(uint32_t));
+    return value;
+}
+
+static size_t lz_hash(uint32_t value) {
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t *lz_write_length(uint8_t *output, size_t length) {
+    while (length >= 255) {
+        *output++ = 255;
+        length -= 255;
+    }
+
+    *output++ = (uint8_t)length;
+
+    return output;
+}
+
+// A match_length of 0 writes the final, literal only sequence.
+static uint8_t *lz_write_sequence(
+    uint8_t *output, const uint8_t *literals, size_t literal_count, size_t offset, size_t match_length) {
+    size_t match_code = match_length > 0 ? match_length - LZ_MIN_MATCH : 0;
+
+    uint8_t *token = output++;
+    *token = (uint8_t)(((literal_count < 15 ? literal_count : 15) << 4) | (match_code < 15 ? match_code : 15));
+
+    if (literal_count >= 15) {
+        output = lz_write_length(output, literal_count - 15);
+    }
+
+    memcpy(output, literals, literal_count);
+    output += literal_count;
+
+    if (match_length == 0) {
+        return output;
+    }
+
+    output[0] = (uint8_t)(offset & 0xff);
+    output[1] = (uint8_t)(offset >> 8);
+    output += 2;
+
+    if (match_code >= 15) {
+        output = lz_write_length(output, match_code - 15);
+    }
+
+    return output;
+}
+
+size_t codec_lz_compress(const uint8_t *source, size_t length, uint8_t *destination) {
+    // Last position seen for each hash of 4 bytes, stale or colliding entries are caught by comparing the bytes.
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    uint8_t *output = destination;
+    size_t anchor = 0;
+    size_t i = 0;
+
+    while (i + LZ_MIN_MATCH <= length) {
+        uint32_t sequence = lz_read_32(source + i);
+        size_t hash = lz_hash(sequence);
+        size_t candidate = table[hash];
+        table[hash] = (uint32_t)i;
+
+        if (candidate >= i || i - candidate > LZ_MAX_OFFSET || lz_read_32(source + candidate) != sequence) {
+            ++i;
+            continue;
+        }
+
+        size_t match_length = LZ_MIN_MATCH;
+        while (i + match_length < length && source[candidate + match_length] == source[i + match_length]) {
+            ++match_length;
+        }
+
+        output = lz_write_sequence(output, source + anchor, i - anchor, i - candidate, match_length);
+        i += match_length;
+        anchor = i;
+    }
+
+    output = lz_write_sequence(output, source + anchor, length - anchor, 0, 0);
+
+    return output - destination;
+}
+
+static bool lz_read_length(const uint8_t *source, size_t source_length, size_t *source_i, size_t *length) {
+    uint8_t byte;
+
+    do {
+        if (*source_i >= source_length) {
+            return false;
+        }
+
+        byte = source[*source_i];
+        ++*source_i;
+        *length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+bool codec_lz_decompress(const uint8_t *source, size_t source_length, uint8_t *destination, size_t destination_length) {
+    size_t source_i = 0;
+    size_t destination_i = 0;
+    // Streams always end with a literal only sequence, so one that stops after a match was cut short.
+    bool is_finished = false;
+
+    while (source_i < source_length) {
+        uint8_t token = source[source_i];
+        ++source_i;
+
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !lz_read_length(source, source_length, &source_i, &literal_count)) {
+            return false;
+        }
+
+        if (literal_count > source_length - source_i || literal_count > destination_length - destination_i) {
+            return false;
+        }
+
+        memcpy(destination + destination_i, source + source_i, literal_count);
+        source_i += literal_count;
+        destination_i += literal_count;
+
+        if (source_i == source_length) {
+            is_finished = true;
+            break;
+        }
+
+        if (source_length - source_i < 2) {
+            return false;
+        }
+
+        size_t offset = source[source_i] | ((size_t)source[source_i + 1] << 8);
+        source_i += 2;
+
+        size_t match_length = token & 0x0f;
+        if (match_length == 15 && !lz_read_length(source, source_length, &source_i, &match_length)) {
+            return false;
+        }
+        match_length += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > destination_i || match_length > destination_length - destination_i) {
+            return false;
+        }
+
+        // Matches can overlap the bytes they produce, so copy forwards one byte at a time.
+        const uint8_t *match = destination + destination_i - offset;
+        for (size_t i = 0; i < match_length; i++) {
+            destination[destination_i + i] = match[i];
+        }
+        destination_i += match_length;
+    }
+
+    return is_finished && destination_i == destination_length;
+}
@@ -0,0 +1,27 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "detect_leak.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Chunk data compression in two passes. Run length encoding collapses the long vertical runs of blocks and light in
+// every column, then an LZ pass removes the repetition between neighbouring columns, which mostly look alike.
+
+// Largest possible output of codec_rle_encode.
+size_t codec_rle_bound(size_t length);
+// Encode runs of equal bytes as (run length - 1, value) pairs, runs are cut every column_length bytes so they never
+// cross a column.
+size_t codec_rle_encode(const uint8_t *source, size_t length, size_t column_length, uint8_t *destination);
+// Decode exactly destination_length bytes, returning the number of source bytes read or 0 if the data is invalid.
+size_t codec_rle_decode(const uint8_t *source, size_t source_length, uint8_t *destination, size_t destination_length);
+
+// Largest possible output of codec_lz_compress.
+size_t codec_lz_bound(size_t length);
+size_t codec_lz_compress(const uint8_t *source, size_t length, uint8_t *destination);
+// Returns false if the data is invalid or doesn't decompress to exactly destination_length bytes.
+bool codec_lz_decompress(const uint8_t *source, size_t source_length, uint8_t *destination, size_t destination_length);
+
+#endif
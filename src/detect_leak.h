@@ -1,3 +1,8 @@
+// Leak detection is only available with the MSVC debug runtime.
+#ifdef _MSC_VER
 #define _CRTDBG_MAP_ALLOC
 #include <stdlib.h>
-#include <crtdbg.h>
\ No newline at end of file
+#include <crtdbg.h>
+#else
+#include <stdlib.h>
+#endif
\ No newline at end of file
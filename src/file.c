@@ -2,10 +2,92 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <assert.h>
 
-char *get_file_string(char *file_path) {
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Returns NULL if the file couldn't be opened. MSVC deprecates fopen in favor of fopen_s, which isn't portable.
+FILE *file_open(char *file_path, char *mode) {
+#ifdef _MSC_VER
     FILE *file;
-    fopen_s(&file, file_path, "rb");
+    if (fopen_s(&file, file_path, mode) != 0) {
+        return NULL;
+    }
+
+    return file;
+#else
+    return fopen(file_path, mode);
+#endif
+}
+
+// Positional reads and writes with pread/pwrite, or overlapped ReadFile/WriteFile on Windows. They don't share the
+// stdio buffer, so flush anything written through the FILE before using them.
+bool file_read_at(FILE *file, uint64_t offset, void *data, size_t length) {
+    uint8_t *bytes = data;
+
+    while (length > 0) {
+#ifdef _WIN32
+        HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+        OVERLAPPED overlapped = {.Offset = (DWORD)offset, .OffsetHigh = (DWORD)(offset >> 32)};
+        DWORD read_length = 0;
+        DWORD request_length = length > 0x40000000 ? 0x40000000 : (DWORD)length;
+
+        if (!ReadFile(handle, bytes, request_length, &read_length, &overlapped) || read_length == 0) {
+            return false;
+        }
+#else
+        ssize_t read_length = pread(fileno(file), bytes, length, (off_t)offset);
+
+        if (read_length <= 0) {
+            return false;
+        }
+#endif
+
+        bytes += read_length;
+        offset += read_length;
+        length -= read_length;
+    }
+
+    return true;
+}
+
+bool file_write_at(FILE *file, uint64_t offset, const void *data, size_t length) {
+    const uint8_t *bytes = data;
+
+    while (length > 0) {
+#ifdef _WIN32
+        HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+        OVERLAPPED overlapped = {.Offset = (DWORD)offset, .OffsetHigh = (DWORD)(offset >> 32)};
+        DWORD written_length = 0;
+        DWORD request_length = length > 0x40000000 ? 0x40000000 : (DWORD)length;
+
+        if (!WriteFile(handle, bytes, request_length, &written_length, &overlapped) || written_length == 0) {
+            return false;
+        }
+#else
+        ssize_t written_length = pwrite(fileno(file), bytes, length, (off_t)offset);
+
+        if (written_length <= 0) {
+            return false;
+        }
+#endif
+
+        bytes += written_length;
+        offset += written_length;
+        length -= written_length;
+    }
+
+    return true;
+}
+
+char *get_file_string(char *file_path) {
+    FILE *file = file_open(file_path, "rb");
 
     if (!file) {
         printf("Failed to open file: %s\n", file_path);
@@ -29,5 +111,40 @@ char *get_file_string(char *file_path) {
     fread(buffer, 1, string_length, file);
     buffer[string_length] = '\0';
 
+    return buffer;
+}
+
+// Read a whole binary file, returning NULL instead of exiting if it can't be read. Like the entries of an asset pack,
+// the data is followed by a zero byte that isn't included in the length.
+uint8_t *get_file_bytes(char *file_path, size_t *length) {
+    FILE *file = file_open(file_path, "rb");
+
+    if (!file) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long file_length = ftell(file);
+    rewind(file);
+
+    if (file_length == -1) {
+        fclose(file);
+        return NULL;
+    }
+
+    uint8_t *buffer = malloc((size_t)file_length + 1);
+    assert(buffer);
+
+    size_t read_length = fread(buffer, 1, (size_t)file_length, file);
+    fclose(file);
+
+    if (read_length != (size_t)file_length) {
+        free(buffer);
+        return NULL;
+    }
+
+    buffer[read_length] = '\0';
+    *length = read_length;
+
     return buffer;
 }
\ No newline at end of file
@@ -3,6 +3,15 @@
 
 #include "detect_leak.h"
 
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+FILE *file_open(char *file_path, char *mode);
+bool file_read_at(FILE *file, uint64_t offset, void *data, size_t length);
+bool file_write_at(FILE *file, uint64_t offset, const void *data, size_t length);
 char *get_file_string(char *file_path);
+uint8_t *get_file_bytes(char *file_path, size_t *length);
 
 #endif
\ No newline at end of file
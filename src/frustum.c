@@ -0,0 +1,118 @@
+#include "frustum.h"
+
+#include <stdlib.h>
+#include <assert.h>
+#include <inttypes.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+struct Frustum frustum_create(mat4s view_projection_matrix) {
+    struct Frustum frustum;
+    glms_frustum_planes(view_projection_matrix, frustum.planes);
+
+    return frustum;
+}
+
+// A box is outside of the frustum if the corner furthest along a plane's normal is still behind that plane.
+bool frustum_contains_box(struct Frustum *frustum, vec3s min, vec3s max) {
+    for (size_t i = 0; i < 6; i++) {
+        vec4s plane = frustum->planes[i];
+        float x = plane.x > 0.0f ? max.x : min.x;
+        float y = plane.y > 0.0f ? max.y : min.y;
+        float z = plane.z > 0.0f ? max.z : min.z;
+
+        if (plane.x * x + plane.y * y + plane.z * z + plane.w < 0.0f) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Same test as frustum_contains_box, but for many boxes. The furthest corner along a plane's normal is picked by
+// choosing between the min and max arrays once per plane, leaving only multiplies and adds in the inner loop.
+void frustum_cull_boxes(struct Frustum *frustum, struct PackedBoxes *boxes, bool *is_visible) {
+    for (size_t i = 0; i < boxes->length; i++) {
+        is_visible[i] = true;
+    }
+
+    for (size_t plane_i = 0; plane_i < 6; plane_i++) {
+        vec4s plane = frustum->planes[plane_i];
+        const float *xs = plane.x > 0.0f ? boxes->max_x : boxes->min_x;
+        const float *ys = plane.y > 0.0f ? boxes->max_y : boxes->min_y;
+        const float *zs = plane.z > 0.0f ? boxes->max_z : boxes->min_z;
+
+        size_t i = 0;
+
+#ifdef FRUSTUM_USE_SSE
+        __m128 plane_x = _mm_set1_ps(plane.x);
+        __m128 plane_y = _mm_set1_ps(plane.y);
+        __m128 plane_z = _mm_set1_ps(plane.z);
+        __m128 plane_w = _mm_set1_ps(plane.w);
+        __m128 zero = _mm_setzero_ps();
+
+        for (; i + 4 <= boxes->length; i += 4) {
+            __m128 distance = _mm_add_ps(_mm_mul_ps(plane_x, _mm_loadu_ps(xs + i)), plane_w);
+            distance = _mm_add_ps(_mm_mul_ps(plane_y, _mm_loadu_ps(ys + i)), distance);
+            distance = _mm_add_ps(_mm_mul_ps(plane_z, _mm_loadu_ps(zs + i)), distance);
+            int32_t is_outside_mask = _mm_movemask_ps(_mm_cmplt_ps(distance, zero));
+
+            if (is_outside_mask == 0) {
+                continue;
+            }
+
+            for (size_t lane_i = 0; lane_i < 4; lane_i++) {
+                if (is_outside_mask & (1 << lane_i)) {
+                    is_visible[i + lane_i] = false;
+                }
+            }
+        }
+#endif
+
+        for (; i < boxes->length; i++) {
+            if (plane.x * xs[i] + plane.y * ys[i] + plane.z * zs[i] + plane.w < 0.0f) {
+                is_visible[i] = false;
+            }
+        }
+    }
+}
+
+struct PackedBoxes packed_boxes_create(size_t length) {
+    struct PackedBoxes boxes = (struct PackedBoxes){
+        .min_x = calloc(length, sizeof(float)),
+        .min_y = calloc(length, sizeof(float)),
+        .min_z = calloc(length, sizeof(float)),
+        .max_x = calloc(length, sizeof(float)),
+        .max_y = calloc(length, sizeof(float)),
+        .max_z = calloc(length, sizeof(float)),
+        .length = length,
+    };
+
+    assert(boxes.min_x && boxes.min_y && boxes.min_z);
+    assert(boxes.max_x && boxes.max_y && boxes.max_z);
+
+    return boxes;
+}
+
+void packed_boxes_set(struct PackedBoxes *boxes, size_t i, vec3s min, vec3s max) {
+    assert(i < boxes->length);
+
+    boxes->min_x[i] = min.x;
+    boxes->min_y[i] = min.y;
+    boxes->min_z[i] = min.z;
+    boxes->max_x[i] = max.x;
+    boxes->max_y[i] = max.y;
+    boxes->max_z[i] = max.z;
+}
+
+void packed_boxes_destroy(struct PackedBoxes *boxes) {
+    free(boxes->min_x);
+    free(boxes->min_y);
+    free(boxes->min_z);
+    free(boxes->max_x);
+    free(boxes->max_y);
+    free(boxes->max_z);
+}
@@ -0,0 +1,34 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "detect_leak.h"
+
+#include <cglm/struct.h>
+
+#include <stdbool.h>
+
+struct Frustum {
+    // Left, right, bottom, top, near, far. Each plane is stored as (normal, distance).
+    vec4s planes[6];
+};
+
+// Axis aligned boxes with each component stored in its own array, so that several boxes can be tested at once.
+struct PackedBoxes {
+    float *min_x;
+    float *min_y;
+    float *min_z;
+    float *max_x;
+    float *max_y;
+    float *max_z;
+    size_t length;
+};
+
+struct Frustum frustum_create(mat4s view_projection_matrix);
+bool frustum_contains_box(struct Frustum *frustum, vec3s min, vec3s max);
+void frustum_cull_boxes(struct Frustum *frustum, struct PackedBoxes *boxes, bool *is_visible);
+
+struct PackedBoxes packed_boxes_create(size_t length);
+void packed_boxes_set(struct PackedBoxes *boxes, size_t i, vec3s min, vec3s max);
+void packed_boxes_destroy(struct PackedBoxes *boxes);
+
+#endif
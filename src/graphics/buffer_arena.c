@@ -0,0 +1,235 @@
+#include "buffer_arena.h"
+#include "mesh.h"
+#include "mesher.h"
+
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+
+// Allocations are rounded up to reduce fragmentation from many slightly different sizes.
+const uint32_t buffer_arena_granularity = 64;
+// New allocations get extra room so that remeshing a chunk after a small edit can usually be written in place.
+const float buffer_arena_spare_capacity = 0.125f;
+
+// Take the first free range that is large enough, returns false if there isn't one.
+bool buffer_range_list_allocate(
+    struct List_struct_BufferRange *free_ranges, uint32_t length, struct BufferRange *range) {
+    for (size_t i = 0; i < free_ranges->length; i++) {
+        struct BufferRange *free_range = &free_ranges->data[i];
+        if (free_range->length < length) {
+            continue;
+        }
+
+        *range = (struct BufferRange){
+            .offset = free_range->offset,
+            .length = length,
+        };
+
+        free_range->offset += length;
+        free_range->length -= length;
+
+        // Remove empty ranges while keeping the list sorted.
+        if (free_range->length == 0) {
+            --free_ranges->length;
+            memmove(free_ranges->data + i, free_ranges->data + i + 1,
+                (free_ranges->length - i) * sizeof(struct BufferRange));
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+// Return a range to the free list, merging it with the free ranges next to it.
+void buffer_range_list_free(struct List_struct_BufferRange *free_ranges, struct BufferRange range) {
+    if (range.length == 0) {
+        return;
+    }
+
+    size_t i = 0;
+    while (i < free_ranges->length && free_ranges->data[i].offset < range.offset) {
+        ++i;
+    }
+
+    struct BufferRange *previous = i > 0 ? &free_ranges->data[i - 1] : NULL;
+    struct BufferRange *next = i < free_ranges->length ? &free_ranges->data[i] : NULL;
+    bool is_previous_adjacent = previous && previous->offset + previous->length == range.offset;
+    bool is_next_adjacent = next && range.offset + range.length == next->offset;
+
+    if (is_previous_adjacent && is_next_adjacent) {
+        previous->length += range.length + next->length;
+        --free_ranges->length;
+        memmove(free_ranges->data + i, free_ranges->data + i + 1,
+            (free_ranges->length - i) * sizeof(struct BufferRange));
+    } else if (is_previous_adjacent) {
+        previous->length += range.length;
+    } else if (is_next_adjacent) {
+        next->offset = range.offset;
+        next->length += range.length;
+    } else {
+        // Grow the list by one, then shift everything after the insertion point over.
+        list_push_struct_BufferRange(free_ranges, range);
+        memmove(free_ranges->data + i + 1, free_ranges->data + i,
+            (free_ranges->length - i - 1) * sizeof(struct BufferRange));
+        free_ranges->data[i] = range;
+    }
+}
+
+// Point the arena's VAO at its current buffers, this needs to happen again whenever a buffer is replaced.
+void buffer_arena_attach_buffers(struct BufferArena *arena) {
+    glBindVertexArray(arena->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, arena->vbo);
+    mesh_set_vertex_attributes();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena->ebo);
+    glBindVertexArray(0);
+}
+
+uint32_t buffer_arena_create_buffer(size_t size) {
+    uint32_t buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+
+    return buffer;
+}
+
+// Allocate a range from one of the arena's buffers. If no free range is large enough the buffer is replaced with
+// a larger copy of itself, this is rare since the arena only ever grows.
+struct BufferRange buffer_arena_allocate(struct List_struct_BufferRange *free_ranges, uint32_t *buffer,
+    uint32_t *capacity, size_t element_size, uint32_t length) {
+    length = (length + buffer_arena_granularity - 1) / buffer_arena_granularity * buffer_arena_granularity;
+
+    struct BufferRange range;
+    while (!buffer_range_list_allocate(free_ranges, length, &range)) {
+        uint32_t new_capacity = *capacity * 2;
+        if (new_capacity < *capacity + length) {
+            new_capacity = *capacity + length;
+        }
+
+        uint32_t new_buffer = buffer_arena_create_buffer(new_capacity * element_size);
+        glBindBuffer(GL_COPY_READ_BUFFER, *buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, *capacity * element_size);
+        glDeleteBuffers(1, buffer);
+
+        buffer_range_list_free(free_ranges, (struct BufferRange){
+                                                .offset = *capacity,
+                                                .length = new_capacity - *capacity,
+                                            });
+
+        *buffer = new_buffer;
+        *capacity = new_capacity;
+    }
+
+    return range;
+}
+
+struct BufferArena buffer_arena_create(uint32_t vertex_capacity, uint32_t index_capacity) {
+    const size_t sizeof_vertex = sizeof(float) * vertex_component_count;
+
+    struct BufferArena arena = (struct BufferArena){
+        .vbo = buffer_arena_create_buffer(vertex_capacity * sizeof_vertex),
+        .ebo = buffer_arena_create_buffer(index_capacity * sizeof(uint32_t)),
+        .vertex_capacity = vertex_capacity,
+        .index_capacity = index_capacity,
+        .free_vertex_ranges = list_create_struct_BufferRange(64),
+        .free_index_ranges = list_create_struct_BufferRange(64),
+    };
+
+    glGenVertexArrays(1, &arena.vao);
+    buffer_arena_attach_buffers(&arena);
+
+    list_push_struct_BufferRange(&arena.free_vertex_ranges, (struct BufferRange){
+                                                                .offset = 0,
+                                                                .length = vertex_capacity,
+                                                            });
+    list_push_struct_BufferRange(&arena.free_index_ranges, (struct BufferRange){
+                                                               .offset = 0,
+                                                               .length = index_capacity,
+                                                           });
+
+    return arena;
+}
+
+// Write a mesh into an allocation that is large enough to hold it.
+void buffer_arena_write(struct BufferArena *arena, struct BufferArenaAllocation *allocation, const float *vertices,
+    uint32_t vertex_count, const uint32_t *indices, uint32_t index_count) {
+    const size_t sizeof_vertex = sizeof(float) * vertex_component_count;
+
+    assert(vertex_count <= allocation->vertices.length);
+    assert(index_count <= allocation->indices.length);
+
+    // Uploads go through the copy target so that the VAO's element buffer binding is never touched.
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena->vbo);
+    glBufferSubData(
+        GL_COPY_WRITE_BUFFER, allocation->vertices.offset * sizeof_vertex, vertex_count * sizeof_vertex, vertices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena->ebo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation->indices.offset * sizeof(uint32_t),
+        index_count * sizeof(uint32_t), indices);
+
+    allocation->index_count = index_count;
+}
+
+struct BufferArenaAllocation buffer_arena_upload(struct BufferArena *arena, const float *vertices,
+    uint32_t vertex_count, const uint32_t *indices, uint32_t index_count) {
+    if (index_count == 0) {
+        return (struct BufferArenaAllocation){0};
+    }
+
+    const size_t sizeof_vertex = sizeof(float) * vertex_component_count;
+    uint32_t vertex_capacity = vertex_count + (uint32_t)(vertex_count * buffer_arena_spare_capacity);
+    uint32_t index_capacity = index_count + (uint32_t)(index_count * buffer_arena_spare_capacity);
+
+    uint32_t old_vbo = arena->vbo;
+    uint32_t old_ebo = arena->ebo;
+
+    struct BufferArenaAllocation allocation = (struct BufferArenaAllocation){
+        .vertices = buffer_arena_allocate(
+            &arena->free_vertex_ranges, &arena->vbo, &arena->vertex_capacity, sizeof_vertex, vertex_capacity),
+        .indices = buffer_arena_allocate(
+            &arena->free_index_ranges, &arena->ebo, &arena->index_capacity, sizeof(uint32_t), index_capacity),
+    };
+
+    if (arena->vbo != old_vbo || arena->ebo != old_ebo) {
+        buffer_arena_attach_buffers(arena);
+    }
+
+    buffer_arena_write(arena, &allocation, vertices, vertex_count, indices, index_count);
+
+    return allocation;
+}
+
+// Replace the mesh stored in an allocation. The mesh is written in place if it fits, otherwise it's moved to a new
+// allocation. Either way no GL objects are created.
+void buffer_arena_update(struct BufferArena *arena, struct BufferArenaAllocation *allocation, const float *vertices,
+    uint32_t vertex_count, const uint32_t *indices, uint32_t index_count) {
+    bool does_fit = vertex_count <= allocation->vertices.length && index_count <= allocation->indices.length;
+
+    if (index_count != 0 && does_fit) {
+        buffer_arena_write(arena, allocation, vertices, vertex_count, indices, index_count);
+        return;
+    }
+
+    buffer_arena_free(arena, allocation);
+    *allocation = buffer_arena_upload(arena, vertices, vertex_count, indices, index_count);
+}
+
+void buffer_arena_free(struct BufferArena *arena, struct BufferArenaAllocation *allocation) {
+    buffer_range_list_free(&arena->free_vertex_ranges, allocation->vertices);
+    buffer_range_list_free(&arena->free_index_ranges, allocation->indices);
+
+    *allocation = (struct BufferArenaAllocation){0};
+}
+
+void buffer_arena_bind(struct BufferArena *arena) {
+    glBindVertexArray(arena->vao);
+}
+
+void buffer_arena_destroy(struct BufferArena *arena) {
+    glDeleteBuffers(1, &arena->vbo);
+    glDeleteBuffers(1, &arena->ebo);
+    glDeleteVertexArrays(1, &arena->vao);
+
+    list_destroy_struct_BufferRange(&arena->free_vertex_ranges);
+    list_destroy_struct_BufferRange(&arena->free_index_ranges);
+}
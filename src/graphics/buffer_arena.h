@@ -0,0 +1,50 @@
+#ifndef BUFFER_ARENA_H
+#define BUFFER_ARENA_H
+
+#include "../detect_leak.h"
+
+#include "../list.h"
+
+#include <glad/glad.h>
+
+#include <inttypes.h>
+
+// A range of elements (vertices or indices) within one of the arena's buffers.
+struct BufferRange {
+    uint32_t offset;
+    uint32_t length;
+};
+
+typedef struct BufferRange struct_BufferRange;
+LIST_DEFINE(struct_BufferRange)
+
+// Stores many meshes in one shared VAO, VBO and EBO so that meshes can be replaced without creating GL objects.
+// Free space in each buffer is tracked by a list of free ranges sorted by offset.
+struct BufferArena {
+    uint32_t vao;
+    uint32_t vbo;
+    uint32_t ebo;
+    uint32_t vertex_capacity;
+    uint32_t index_capacity;
+    struct List_struct_BufferRange free_vertex_ranges;
+    struct List_struct_BufferRange free_index_ranges;
+};
+
+// Indices are relative to the first vertex of the allocation, so they don't need to be offset when uploading.
+// The ranges may be larger than the mesh, leaving room for it to grow in place.
+struct BufferArenaAllocation {
+    struct BufferRange vertices;
+    struct BufferRange indices;
+    uint32_t index_count;
+};
+
+struct BufferArena buffer_arena_create(uint32_t vertex_capacity, uint32_t index_capacity);
+struct BufferArenaAllocation buffer_arena_upload(struct BufferArena *arena, const float *vertices,
+    uint32_t vertex_count, const uint32_t *indices, uint32_t index_count);
+void buffer_arena_update(struct BufferArena *arena, struct BufferArenaAllocation *allocation, const float *vertices,
+    uint32_t vertex_count, const uint32_t *indices, uint32_t index_count);
+void buffer_arena_free(struct BufferArena *arena, struct BufferArenaAllocation *allocation);
+void buffer_arena_bind(struct BufferArena *arena);
+void buffer_arena_destroy(struct BufferArena *arena);
+
+#endif
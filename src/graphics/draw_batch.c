@@ -0,0 +1,104 @@
+#include "draw_batch.h"
+
+#include <GLFW/glfw3.h>
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+// Indirect drawing is newer than the OpenGL version glad was generated for, so it's loaded here if it's available.
+typedef void(APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(
+    GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+static PFNGLMULTIDRAWELEMENTSINDIRECTPROC multi_draw_elements_indirect = NULL;
+
+struct DrawBatch draw_batch_create(void) {
+    if (glfwExtensionSupported("GL_ARB_multi_draw_indirect")) {
+        multi_draw_elements_indirect =
+            (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)glfwGetProcAddress("glMultiDrawElementsIndirect");
+    }
+
+    struct DrawBatch batch = (struct DrawBatch){
+        .counts = list_create_int32_t(64),
+        .offsets = list_create_uintptr_t(64),
+        .base_vertices = list_create_int32_t(64),
+        .commands = list_create_struct_DrawElementsIndirectCommand(64),
+        .is_indirect = multi_draw_elements_indirect != NULL,
+    };
+
+    if (batch.is_indirect) {
+        glGenBuffers(1, &batch.indirect_buffer);
+    }
+
+    return batch;
+}
+
+void draw_batch_begin(struct DrawBatch *batch) {
+    list_reset_int32_t(&batch->counts);
+    list_reset_uintptr_t(&batch->offsets);
+    list_reset_int32_t(&batch->base_vertices);
+    list_reset_struct_DrawElementsIndirectCommand(&batch->commands);
+}
+
+// Add a range of an allocation's indices to the batch, the first index is relative to the start of the allocation.
+void draw_batch_add(
+    struct DrawBatch *batch, struct BufferArenaAllocation *allocation, uint32_t first_index, uint32_t index_count) {
+    if (index_count == 0) {
+        return;
+    }
+
+    assert(first_index + index_count <= allocation->index_count);
+
+    if (batch->is_indirect) {
+        struct DrawElementsIndirectCommand command = (struct DrawElementsIndirectCommand){
+            .count = index_count,
+            .instance_count = 1,
+            .first_index = allocation->indices.offset + first_index,
+            .base_vertex = allocation->vertices.offset,
+            .base_instance = 0,
+        };
+        list_push_struct_DrawElementsIndirectCommand(&batch->commands, command);
+        return;
+    }
+
+    list_push_int32_t(&batch->counts, index_count);
+    list_push_uintptr_t(&batch->offsets, sizeof(uint32_t) * (allocation->indices.offset + first_index));
+    list_push_int32_t(&batch->base_vertices, allocation->vertices.offset);
+}
+
+void draw_batch_draw(struct DrawBatch *batch, struct BufferArena *arena) {
+    buffer_arena_bind(arena);
+
+    if (batch->is_indirect) {
+        if (batch->commands.length == 0) {
+            return;
+        }
+
+        // Orphan the previous frame's commands instead of waiting for the GPU to finish reading them.
+        size_t commands_size = batch->commands.length * sizeof(struct DrawElementsIndirectCommand);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, batch->indirect_buffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands_size, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands_size, batch->commands.data);
+        multi_draw_elements_indirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, batch->commands.length, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        return;
+    }
+
+    if (batch->counts.length == 0) {
+        return;
+    }
+
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, batch->counts.data, GL_UNSIGNED_INT,
+        (const void *const *)batch->offsets.data, batch->counts.length, batch->base_vertices.data);
+}
+
+void draw_batch_destroy(struct DrawBatch *batch) {
+    if (batch->is_indirect) {
+        glDeleteBuffers(1, &batch->indirect_buffer);
+    }
+
+    list_destroy_int32_t(&batch->counts);
+    list_destroy_uintptr_t(&batch->offsets);
+    list_destroy_int32_t(&batch->base_vertices);
+    list_destroy_struct_DrawElementsIndirectCommand(&batch->commands);
+}
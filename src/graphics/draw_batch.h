@@ -0,0 +1,45 @@
+#ifndef DRAW_BATCH_H
+#define DRAW_BATCH_H
+
+#include "../detect_leak.h"
+
+#include "../list.h"
+#include "buffer_arena.h"
+
+#include <glad/glad.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+// Matches the layout glMultiDrawElementsIndirect expects.
+struct DrawElementsIndirectCommand {
+    uint32_t count;
+    uint32_t instance_count;
+    uint32_t first_index;
+    int32_t base_vertex;
+    uint32_t base_instance;
+};
+
+typedef struct DrawElementsIndirectCommand struct_DrawElementsIndirectCommand;
+LIST_DEFINE(struct_DrawElementsIndirectCommand)
+LIST_DEFINE(uintptr_t)
+
+// Collects allocations from a buffer arena so that all of them can be drawn with a single draw call.
+// glMultiDrawElementsIndirect is used when it's supported, otherwise glMultiDrawElementsBaseVertex is used.
+struct DrawBatch {
+    struct List_int32_t counts;
+    struct List_uintptr_t offsets;
+    struct List_int32_t base_vertices;
+    struct List_struct_DrawElementsIndirectCommand commands;
+    uint32_t indirect_buffer;
+    bool is_indirect;
+};
+
+struct DrawBatch draw_batch_create(void);
+void draw_batch_begin(struct DrawBatch *batch);
+void draw_batch_add(
+    struct DrawBatch *batch, struct BufferArenaAllocation *allocation, uint32_t first_index, uint32_t index_count);
+void draw_batch_draw(struct DrawBatch *batch, struct BufferArena *arena);
+void draw_batch_destroy(struct DrawBatch *batch);
+
+#endif
@@ -1,8 +1,11 @@
 #include "mesher.h"
 #include "../directions.h"
+#include "../visibility.h"
+#include "../trace.h"
 
 #include <cglm/struct.h>
 
+const size_t vertex_component_count = 9;
 const float cube_texture_size = 16.0f;
 
 const vec3s cube_vertices[6][4] = {
@@ -113,31 +116,73 @@ const float cube_shades[6] = {
     0.875f, // Down
 };
 
+// Downsampled chunks include a border of cells from neighboring chunks, so that faces can be culled across chunks.
+#define LOD_CELL_INDEX(x, y, z, cells_y, cells_xz) ((y) + (x)*cells_y + (z)*cells_y * cells_xz)
+
 struct Mesher mesher_create(void) {
-    return (struct Mesher){
+    // The largest downsampled chunk is the one with 2x2x2 block cells.
+    const size_t lod_cells_length = (CHUNK_SIZE / 2 + 2) * (CHUNK_SIZE / 2 + 2) * (chunk_height / 2 + 2);
+
+    struct Mesher mesher = (struct Mesher){
         .vertices = list_create_float(4096),
         .indices = list_create_uint32_t(4096),
         .processed_chunk_i = -1,
+        .lod_cells = malloc(lod_cells_length * sizeof(uint8_t)),
     };
+
+    assert(mesher.lod_cells);
+
+    return mesher;
 }
 
-void mesher_mesh_chunk(struct Mesher *mesher, struct World *world, struct Chunk *chunk, int32_t texture_atlas_width,
-    int32_t texture_atlas_height) {
+// Add one side of a box to the mesh. Textures are repeated across large boxes instead of being stretched.
+void mesher_add_face(struct Mesher *mesher, size_t side_i, vec3s position, vec3s size, float sunlight_level,
+    float light_level, float texture_index, float texture_scale) {
+    uint32_t vertex_count = mesher->vertices.length / vertex_component_count;
 
-    list_reset_float(&mesher->vertices);
-    list_reset_uint32_t(&mesher->indices);
+    for (size_t index_i = 0; index_i < 6; index_i++) {
+        uint32_t index = vertex_count + cube_indices[side_i][index_i];
+        list_push_uint32_t(&mesher->indices, index);
+    }
+
+    for (size_t vertex_i = 0; vertex_i < 4; vertex_i++) {
+        // Position:
+        float vertex_x = position.x + cube_vertices[side_i][vertex_i].x * size.x;
+        float vertex_y = position.y + cube_vertices[side_i][vertex_i].y * size.y;
+        float vertex_z = position.z + cube_vertices[side_i][vertex_i].z * size.z;
+        list_push_float(&mesher->vertices, vertex_x);
+        list_push_float(&mesher->vertices, vertex_y);
+        list_push_float(&mesher->vertices, vertex_z);
 
+        // Color:
+        list_push_float(&mesher->vertices, cube_shades[side_i]);
+        list_push_float(&mesher->vertices, sunlight_level);
+        list_push_float(&mesher->vertices, light_level);
+
+        // UV:
+        float u = cube_uvs[side_i][vertex_i].u * texture_scale;
+        float v = cube_uvs[side_i][vertex_i].v * texture_scale;
+        list_push_float(&mesher->vertices, u);
+        list_push_float(&mesher->vertices, v);
+        list_push_float(&mesher->vertices, texture_index);
+    }
+}
+
+void mesher_mesh_section(struct Mesher *mesher, struct World *world, struct Chunk *chunk, int32_t section_y) {
     uint8_t neighbors[6];
     float neighbor_sunlight_levels[6];
     float neighbor_light_levels[6];
 
+    int32_t section_min_y = section_y * CHUNK_SIZE;
+    int32_t section_max_y = section_min_y + CHUNK_SIZE - 1;
+
     for (int32_t z = 0; z < CHUNK_SIZE; z++) {
         int32_t world_z = z + chunk->z;
         for (int32_t x = 0; x < CHUNK_SIZE; x++) {
             int32_t world_x = x + chunk->x;
             int32_t heightmap_i = HEIGHTMAP_INDEX(x, z);
-            int32_t y_min = chunk->heightmap_min[heightmap_i];
-            int32_t y_max = chunk->heightmap_max[heightmap_i];
+            int32_t y_min = GLM_MAX(chunk->heightmap_min[heightmap_i], section_min_y);
+            int32_t y_max = GLM_MIN(chunk->heightmap_max[heightmap_i], section_max_y);
             for (int32_t y = y_min; y <= y_max; y++) {
                 uint8_t block = world_get_block(world, world_x, y, world_z);
                 // Don't include empty blocks in the mesh.
@@ -167,41 +212,186 @@ void mesher_mesh_chunk(struct Mesher *mesher, struct World *world, struct Chunk
                         continue;
                     }
 
-                    uint32_t vertex_count = mesher->vertices.length / vertex_component_count;
+                    mesher_add_face(mesher, side_i, (vec3s){{world_x, y, world_z}}, (vec3s){{1.0f, 1.0f, 1.0f}},
+                        neighbor_sunlight_levels[side_i], neighbor_light_levels[side_i], block_texture_index, 1.0f);
+                }
+            }
+        }
+    }
+}
+
+// A cell is solid if most of its blocks are solid. Solid cells take the type of their highest block, so that the
+// surface of the terrain keeps its texture. The cell's blocks are in the chunk and x and z are relative to it, only
+// blocks from min_y to max_y are read since the rest of the cell's columns are air.
+uint8_t mesher_get_lod_cell(
+    struct Chunk *chunk, int32_t x, int32_t y, int32_t z, int32_t scale, int32_t min_y, int32_t max_y) {
+    int32_t solid_count = 0;
+    uint8_t top_block = 0;
 
-                    for (size_t index_i = 0; index_i < 6; index_i++) {
-                        uint32_t index = vertex_count + cube_indices[side_i][index_i];
-                        list_push_uint32_t(&mesher->indices, index);
+    for (int32_t block_y = GLM_MAX(y, min_y); block_y < y + scale && block_y <= max_y; block_y++) {
+        for (int32_t block_z = z; block_z < z + scale; block_z++) {
+            for (int32_t block_x = x; block_x < x + scale; block_x++) {
+                uint8_t block = chunk->blocks[BLOCK_INDEX(block_x, block_y, block_z)];
+                if (block != 0) {
+                    ++solid_count;
+                    top_block = block;
+                }
+            }
+        }
+    }
+
+    return solid_count * 2 >= scale * scale * scale ? top_block : 0;
+}
+
+// Cells include a border that belongs to the neighboring chunks. The chunk size is a multiple of the scale, so every
+// column of cells is inside a single chunk or outside of the world.
+void mesher_downsample_chunk(struct Mesher *mesher, struct World *world, struct Chunk *chunk, int32_t scale) {
+    const int32_t cells_xz = CHUNK_SIZE / scale + 2;
+    const int32_t cells_y = chunk_height / scale + 2;
+
+    for (int32_t z = 0; z < cells_xz; z++) {
+        int32_t world_z = chunk->z + (z - 1) * scale;
+        for (int32_t x = 0; x < cells_xz; x++) {
+            int32_t world_x = chunk->x + (x - 1) * scale;
+            bool is_outside_world =
+                world_x < 0 || world_x >= world_size_in_blocks || world_z < 0 || world_z >= world_size_in_blocks;
+
+            struct Chunk *column_chunk = NULL;
+            int32_t block_x = 0;
+            int32_t block_z = 0;
+            int32_t min_y = chunk_height;
+            int32_t max_y = -1;
+
+            if (!is_outside_world) {
+                column_chunk = &world->chunks[CHUNK_INDEX(world_x / CHUNK_SIZE, world_z / CHUNK_SIZE)];
+                block_x = world_x % CHUNK_SIZE;
+                block_z = world_z % CHUNK_SIZE;
+
+                for (int32_t heightmap_z = block_z; heightmap_z < block_z + scale; heightmap_z++) {
+                    for (int32_t heightmap_x = block_x; heightmap_x < block_x + scale; heightmap_x++) {
+                        int32_t heightmap_i = HEIGHTMAP_INDEX(heightmap_x, heightmap_z);
+                        min_y = GLM_MIN(min_y, column_chunk->heightmap_min[heightmap_i]);
+                        max_y = GLM_MAX(max_y, column_chunk->heightmap_max[heightmap_i]);
                     }
+                }
+            }
+
+            for (int32_t y = 0; y < cells_y; y++) {
+                int32_t world_y = (y - 1) * scale;
+                uint8_t *cell = &mesher->lod_cells[LOD_CELL_INDEX(x, y, z, cells_y, cells_xz)];
 
-                    for (size_t vertex_i = 0; vertex_i < 4; vertex_i++) {
-                        // Position:
-                        float vertex_x = chunk->x + x + cube_vertices[side_i][vertex_i].x;
-                        float vertex_y = y + cube_vertices[side_i][vertex_i].y;
-                        float vertex_z = chunk->z + z + cube_vertices[side_i][vertex_i].z;
-                        list_push_float(&mesher->vertices, vertex_x);
-                        list_push_float(&mesher->vertices, vertex_y);
-                        list_push_float(&mesher->vertices, vertex_z);
-
-                        // Color:
-                        list_push_float(&mesher->vertices, cube_shades[side_i]);
-                        list_push_float(&mesher->vertices, neighbor_sunlight_levels[side_i]);
-                        list_push_float(&mesher->vertices, neighbor_light_levels[side_i]);
-
-                        // UV:
-                        float u = cube_uvs[side_i][vertex_i].u;
-                        float v = cube_uvs[side_i][vertex_i].v;
-                        list_push_float(&mesher->vertices, u);
-                        list_push_float(&mesher->vertices, v);
-                        list_push_float(&mesher->vertices, block_texture_index);
+                // Everything above the world is air, everything below it and around it is solid.
+                if (world_y >= (int32_t)chunk_height) {
+                    *cell = 0;
+                } else if (world_y < 0 || is_outside_world) {
+                    *cell = 1;
+                } else if (world_y > max_y || world_y + scale <= min_y) {
+                    *cell = 0;
+                } else {
+                    *cell = mesher_get_lod_cell(column_chunk, block_x, world_y, block_z, scale, min_y, max_y);
+                }
+            }
+        }
+    }
+}
+
+// Mesh a section of a chunk that has already been downsampled. The neighboring chunk might use a different level of
+// detail, so surface cells on the edge of the chunk get skirts: sides that always exist and hang down an extra cell
+// to cover any cracks between the two meshes.
+void mesher_mesh_section_lod(
+    struct Mesher *mesher, struct World *world, struct Chunk *chunk, int32_t section_y, int32_t scale) {
+    const int32_t cells_xz = CHUNK_SIZE / scale + 2;
+    const int32_t cells_y = chunk_height / scale + 2;
+
+    // Cell coordinates start at 1, cells at 0 and at the end of each axis belong to neighboring chunks.
+    int32_t min_y = section_y * CHUNK_SIZE / scale + 1;
+    int32_t max_y = (section_y + 1) * CHUNK_SIZE / scale;
+
+    for (int32_t z = 1; z < cells_xz - 1; z++) {
+        for (int32_t x = 1; x < cells_xz - 1; x++) {
+            for (int32_t y = min_y; y <= max_y; y++) {
+                uint8_t block = mesher->lod_cells[LOD_CELL_INDEX(x, y, z, cells_y, cells_xz)];
+                if (block == 0) {
+                    continue;
+                }
+
+                bool is_surface = mesher->lod_cells[LOD_CELL_INDEX(x, y + 1, z, cells_y, cells_xz)] == 0;
+                vec3s position = {{chunk->x + (x - 1) * scale, (y - 1) * scale, chunk->z + (z - 1) * scale}};
+
+                for (size_t side_i = 0; side_i < 6; side_i++) {
+                    int32_t neighbor_x = x + directions[side_i].x;
+                    int32_t neighbor_y = y + directions[side_i].y;
+                    int32_t neighbor_z = z + directions[side_i].z;
+                    uint8_t neighbor =
+                        mesher->lod_cells[LOD_CELL_INDEX(neighbor_x, neighbor_y, neighbor_z, cells_y, cells_xz)];
+
+                    bool is_on_chunk_edge =
+                        neighbor_x == 0 || neighbor_x == cells_xz - 1 || neighbor_z == 0 || neighbor_z == cells_xz - 1;
+                    bool is_skirt = is_surface && is_on_chunk_edge;
+
+                    if (neighbor != 0 && !is_skirt) {
+                        continue;
                     }
+
+                    vec3s face_position = position;
+                    vec3s face_size = {{scale, scale, scale}};
+
+                    if (is_skirt && y > 1) {
+                        face_position.y -= scale;
+                        face_size.y += scale;
+                    }
+
+                    // Sample the light from the top of the neighboring cell if it's air, otherwise from above it.
+                    int32_t light_x = position.x + directions[side_i].x * scale + scale / 2;
+                    int32_t light_y = position.y + directions[side_i].y * scale + (neighbor == 0 ? scale - 1 : scale);
+                    int32_t light_z = position.z + directions[side_i].z * scale + scale / 2;
+                    uint8_t sunlight_level =
+                        world_get_light_level(world, light_x, light_y, light_z, sunlight_mask, sunlight_offset);
+                    uint8_t light_level =
+                        world_get_light_level(world, light_x, light_y, light_z, light_mask, light_offset);
+
+                    mesher_add_face(mesher, side_i, face_position, face_size, sunlight_level * inv_light_level_count,
+                        light_level * inv_light_level_count, block - 1, scale);
                 }
             }
         }
     }
 }
 
+void mesher_mesh_chunk(struct Mesher *mesher, struct World *world, struct Chunk *chunk, int32_t lod,
+    int32_t texture_atlas_width, int32_t texture_atlas_height) {
+    assert(lod >= 0 && lod < LOD_COUNT);
+
+    TRACE_BEGIN("mesher_mesh_chunk");
+
+    list_reset_float(&mesher->vertices);
+    list_reset_uint32_t(&mesher->indices);
+
+    int32_t scale = 1 << lod;
+
+    if (lod > 0) {
+        mesher_downsample_chunk(mesher, world, chunk, scale);
+    }
+
+    for (int32_t section_y = 0; section_y < CHUNK_SECTION_COUNT; section_y++) {
+        struct MeshSection *section = &mesher->sections[section_y];
+        section->first_index = mesher->indices.length;
+        mesher->section_visibility[section_y] = visibility_compute_section(chunk, section_y);
+
+        if (lod > 0) {
+            mesher_mesh_section_lod(mesher, world, chunk, section_y, scale);
+        } else {
+            mesher_mesh_section(mesher, world, chunk, section_y);
+        }
+
+        section->index_count = mesher->indices.length - section->first_index;
+    }
+
+    TRACE_END("mesher_mesh_chunk");
+}
+
 void mesher_destroy(struct Mesher *mesher) {
     list_destroy_float(&mesher->vertices);
     list_destroy_uint32_t(&mesher->indices);
-}
\ No newline at end of file
+    free(mesher->lod_cells);
+}
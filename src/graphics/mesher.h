@@ -3,19 +3,35 @@
 
 #include "../detect_leak.h"
 
-#include "mesh.h"
 #include "../chunk.h"
 #include "../world.h"
 #include "../list.h"
 
+// Meshes are generated into plain CPU buffers, each vertex has a position, color and texture coordinate.
+extern const size_t vertex_component_count;
+
+// Each level of detail halves the resolution of the previous one, the lowest detail level uses 8x8x8 block cells.
+#define LOD_COUNT 4
+
+// The part of a chunk's mesh that belongs to one of its sections.
+struct MeshSection {
+    uint32_t first_index;
+    uint32_t index_count;
+};
+
 struct Mesher {
     struct List_float vertices;
     struct List_uint32_t indices;
     int32_t processed_chunk_i;
+    // Indices are grouped by section so that sections can be culled separately.
+    struct MeshSection sections[CHUNK_SECTION_COUNT];
+    uint16_t section_visibility[CHUNK_SECTION_COUNT];
+    // Scratch space for the downsampled chunk used when meshing at a lower level of detail.
+    uint8_t *lod_cells;
 };
 
 struct Mesher mesher_create(void);
-void mesher_mesh_chunk(struct Mesher *mesher, struct World *world, struct Chunk *chunk,
+void mesher_mesh_chunk(struct Mesher *mesher, struct World *world, struct Chunk *chunk, int32_t lod,
     int32_t texture_atlas_width, int32_t texture_atlas_height);
 void mesher_destroy(struct Mesher *mesher);
 
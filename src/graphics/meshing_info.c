@@ -1,121 +1,398 @@
 #include "meshing_info.h"
+#include "../trace.h"
+
+#include <GLFW/glfw3.h>
+
+#include <string.h>
+#include <math.h>
 
 // 6 seems like the maximum reasonable number of chunks updates, ie: from placing a light that then lights several
 // neighboring chunks. With 6 meshers that entire update could be processed in a single batch.
 const size_t mesher_count = 6;
+// Must be a power of two that is at least mesher_count.
+const size_t mesher_queue_capacity = 8;
+// Enough space for over a hundred typical chunk meshes, the arena grows if it runs out.
+const uint32_t arena_vertex_capacity = 1 << 18;
+const uint32_t arena_index_capacity = arena_vertex_capacity / 4 * 6;
+// Chunks switch to the next lower level of detail once they're further away than its distance,
+// and only switch back once they're closer than that distance minus the hysteresis. The camera stays inside the world,
+// which is only 64 blocks across, so no chunk is more than about 80 blocks away and these are scaled to fit in that.
+// They should grow with the world and the far plane.
+const float lod_distances[LOD_COUNT] = {0.0f, 24.0f, 40.0f, 56.0f};
+const float lod_hysteresis = 4.0f;
+// Uploads stop for the frame once either budget is used up, the rest are carried over to the next frame.
+const size_t upload_byte_budget = 4 * 1024 * 1024;
+const double upload_time_budget = 0.002;
 const size_t light_update_size = MAX_LIGHT_LEVEL * 2 + 1;
 
 #define LIGHT_LEVEL_CACHE_INDEX(x, y, z) ((y) + (x)*chunk_height + (z)*chunk_height * light_update_size)
 
-DWORD WINAPI meshing_thread_start(void *start_info) {
-    struct MeshingInfo *info = start_info;
-    while (!info->is_done) {
-        WaitForSingleObject(info->world->mutex, INFINITE);
+// Player edits come first, then chunks the player can see, then the chunks closest to the player.
+int meshing_job_compare(const void *a, const void *b) {
+    const struct MeshingJob *job_a = a;
+    const struct MeshingJob *job_b = b;
 
-        world_update_lighting(info->world);
+    if (job_a->is_edited != job_b->is_edited) {
+        return job_a->is_edited ? -1 : 1;
+    }
 
-        // Process meshing updates:
-        for (int32_t i = 0; i < world_length; i++) {
-            if (!info->world->chunks[i].is_dirty) {
-                continue;
-            }
+    if (job_a->is_visible != job_b->is_visible) {
+        return job_a->is_visible ? -1 : 1;
+    }
 
-            size_t available_mesher_i = -1;
+    if (job_a->distance_squared != job_b->distance_squared) {
+        return job_a->distance_squared < job_b->distance_squared ? -1 : 1;
+    }
 
-            for (size_t mesher_i = 0; mesher_i < mesher_count; mesher_i++) {
-                if (info->meshers[mesher_i].processed_chunk_i == -1) {
-                    available_mesher_i = mesher_i;
-                    break;
-                }
-            }
+    return 0;
+}
 
-            // No meshers are available right now.
-            if (available_mesher_i == -1) {
-                break;
-            }
+int32_t meshing_info_select_lod(int32_t lod, float distance) {
+    while (lod + 1 < LOD_COUNT && distance > lod_distances[lod + 1]) {
+        ++lod;
+    }
+
+    while (lod > 0 && distance < lod_distances[lod] - lod_hysteresis) {
+        --lod;
+    }
+
+    return lod;
+}
+
+// Fill the job list with dirty chunks sorted by priority, optionally ignoring chunks that weren't edited by the player.
+void meshing_info_schedule_jobs(struct MeshingInfo *info, bool only_edited) {
+    mutex_lock(info->camera_mutex);
+    vec3s camera_position = info->camera_position;
+    struct Frustum camera_frustum = info->camera_frustum;
+    mutex_unlock(info->camera_mutex);
+
+    list_reset_struct_MeshingJob(&info->jobs);
+
+    for (int32_t i = 0; i < world_length; i++) {
+        struct Chunk *chunk = &info->world->chunks[i];
+
+        // Chunks span the entire height of the world, so only the horizontal distance matters.
+        vec3s center = {{chunk->x + CHUNK_SIZE * 0.5f, camera_position.y, chunk->z + CHUNK_SIZE * 0.5f}};
+        float distance_squared = glms_vec3_distance2(camera_position, center);
+
+        // Chunks that changed level of detail need to be remeshed.
+        int32_t lod = meshing_info_select_lod(info->chunk_lods[i], sqrtf(distance_squared));
+        if (lod != info->chunk_lods[i]) {
+            info->chunk_lods[i] = lod;
+            chunk->is_dirty = true;
+        }
+
+        if (!chunk->is_dirty || (only_edited && !chunk->is_edited)) {
+            continue;
+        }
+
+        vec3s min = {{chunk->x, 0.0f, chunk->z}};
+        vec3s max = {{chunk->x + CHUNK_SIZE, chunk_height, chunk->z + CHUNK_SIZE}};
+
+        list_push_struct_MeshingJob(&info->jobs, (struct MeshingJob){
+                                                     .chunk_i = i,
+                                                     .is_edited = chunk->is_edited,
+                                                     .is_visible = frustum_contains_box(&camera_frustum, min, max),
+                                                     .distance_squared = distance_squared,
+                                                 });
+    }
 
-            info->world->chunks[i].is_dirty = false;
+    qsort(info->jobs.data, info->jobs.length, sizeof(struct MeshingJob), meshing_job_compare);
+}
+
+// Give the highest priority jobs to the available meshers, returning the number of jobs that were run.
+size_t meshing_info_run_jobs(struct MeshingInfo *info) {
+    uint32_t mesher_i;
 
-            mesher_mesh_chunk(&info->meshers[available_mesher_i], info->world, &info->world->chunks[i],
-                info->texture_atlas_width, info->texture_atlas_height);
-            info->meshers[available_mesher_i].processed_chunk_i = i;
+    size_t job_i;
+    for (job_i = 0; job_i < info->jobs.length; job_i++) {
+        if (!queue_pop_uint32_t(&info->free_meshers, &mesher_i)) {
+            break;
         }
 
-        ReleaseMutex(info->world->mutex);
+        int32_t chunk_i = info->jobs.data[job_i].chunk_i;
+
+        info->world->chunks[chunk_i].is_dirty = false;
+        info->world->chunks[chunk_i].is_edited = false;
 
-        Sleep(0);
+        mesher_mesh_chunk(&info->meshers[mesher_i], info->world, &info->world->chunks[chunk_i],
+            info->chunk_lods[chunk_i], info->texture_atlas_width, info->texture_atlas_height);
+        info->meshers[mesher_i].processed_chunk_i = chunk_i;
+
+        // Pushing can't fail, each queue has room for every mesher.
+        queue_push_struct_MeshedChunk(&info->meshed_chunks, (struct MeshedChunk){
+                                                                .mesher_i = mesher_i,
+                                                                .job = info->jobs.data[job_i],
+                                                            });
     }
 
-    return 0;
+    return job_i;
+}
+
+void meshing_thread_start(void *start_info) {
+    struct MeshingInfo *info = start_info;
+    TRACE_THREAD_NAME("meshing");
+
+    while (!info->is_done) {
+        TRACE_BEGIN("world_mutex_wait");
+        mutex_lock(info->world->mutex);
+        TRACE_END("world_mutex_wait");
+
+        bool did_work =
+            info->world->priority_lighting_updates.length > 0 || info->world->lighting_updates.length > 0;
+
+        // Player edits are lit and meshed first so that they don't wait behind large lighting updates.
+        world_update_priority_lighting(info->world);
+        meshing_info_schedule_jobs(info, true);
+        did_work |= meshing_info_run_jobs(info) > 0;
+
+        world_update_lighting(info->world);
+        meshing_info_schedule_jobs(info, false);
+        did_work |= meshing_info_run_jobs(info) > 0;
+
+        mutex_unlock(info->world->mutex);
+
+        // With nothing left to do, or no free meshers to do it with, sleep until the main thread's next frame.
+        if (!did_work) {
+            mutex_lock(info->camera_mutex);
+
+            while (!info->has_new_work && !info->is_done) {
+                condition_wait(info->work_condition, info->camera_mutex);
+            }
+
+            info->has_new_work = false;
+            mutex_unlock(info->camera_mutex);
+        }
+    }
 }
 
 struct MeshingInfo meshing_info_create(struct World *world, int32_t texture_atlas_width, int32_t texture_atlas_height) {
     const size_t light_update_length = light_update_size * light_update_size * chunk_height;
+    const size_t section_total = world_length * CHUNK_SECTION_COUNT;
 
     struct MeshingInfo info = (struct MeshingInfo){
         .world = world,
-        .meshes = calloc(world_length, sizeof(struct Mesh)),
+        .jobs = list_create_struct_MeshingJob(world_length),
+        .camera_mutex = mutex_create(),
+        .camera_position = {{0.0f, 0.0f, 0.0f}},
+        .work_condition = condition_create(),
+        .has_new_work = false,
+        .arena = buffer_arena_create(arena_vertex_capacity, arena_index_capacity),
+        .allocations = calloc(world_length, sizeof(struct BufferArenaAllocation)),
+        .chunk_lods = calloc(world_length, sizeof(int32_t)),
+        .draw_batch = draw_batch_create(),
+        .sections = calloc(section_total, sizeof(struct MeshSection)),
+        .section_visibility = malloc(section_total * sizeof(uint16_t)),
+        .section_bounds = packed_boxes_create(section_total),
+        .is_section_in_frustum = malloc(section_total * sizeof(bool)),
+        .is_section_visible = malloc(section_total * sizeof(bool)),
+        .visibility_steps = list_create_struct_VisibilityStep(section_total),
         .meshers = malloc(mesher_count * sizeof(struct Mesher)),
+        .free_meshers = queue_create_uint32_t(mesher_queue_capacity),
+        .meshed_chunks = queue_create_struct_MeshedChunk(mesher_queue_capacity),
+        .pending_uploads = list_create_struct_MeshedChunk(mesher_count),
+        .upload_stats = {0},
         .light_level_cache = malloc(light_update_length * sizeof(uint8_t)),
         .is_done = false,
         .texture_atlas_width = texture_atlas_width,
         .texture_atlas_height = texture_atlas_height,
     };
 
-    assert(info.meshes);
+    assert(info.allocations);
+    assert(info.chunk_lods);
+    assert(info.sections);
+    assert(info.section_visibility);
+    assert(info.is_section_in_frustum);
+    assert(info.is_section_visible);
     assert(info.meshers);
     assert(info.light_level_cache);
 
+    // Sections that haven't been meshed yet can't block the visibility search.
+    for (size_t chunk_i = 0; chunk_i < world_length; chunk_i++) {
+        struct Chunk *chunk = &world->chunks[chunk_i];
+
+        for (int32_t section_y = 0; section_y < CHUNK_SECTION_COUNT; section_y++) {
+            size_t section_i = SECTION_INDEX(chunk_i, section_y);
+            info.section_visibility[section_i] = VISIBILITY_ALL;
+            packed_boxes_set(&info.section_bounds, section_i, (vec3s){{chunk->x, section_y * CHUNK_SIZE, chunk->z}},
+                (vec3s){{chunk->x + CHUNK_SIZE, (section_y + 1) * CHUNK_SIZE, chunk->z + CHUNK_SIZE}});
+        }
+    }
+
     for (size_t i = 0; i < mesher_count; i++) {
         info.meshers[i] = mesher_create();
+        queue_push_uint32_t(&info.free_meshers, i);
     }
 
     return info;
 }
 
-void meshing_info_upload(struct MeshingInfo *info) {
-    // Try to lock the world mutex.
-    DWORD wait_result = WaitForSingleObject(info->world->mutex, 0);
-    if (wait_result != WAIT_OBJECT_0) {
+// Called once per frame, after the frame's edits, which also wakes the meshing thread if it was idle.
+void meshing_info_set_camera(struct MeshingInfo *info, vec3s position, struct Frustum *frustum) {
+    mutex_lock(info->camera_mutex);
+    info->camera_position = position;
+    info->camera_frustum = *frustum;
+    info->has_new_work = true;
+    condition_signal(info->work_condition);
+    mutex_unlock(info->camera_mutex);
+}
+
+// Ask the meshing thread to exit, waking it if it's idle.
+void meshing_info_stop(struct MeshingInfo *info) {
+    mutex_lock(info->camera_mutex);
+    info->is_done = true;
+    condition_signal(info->work_condition);
+    mutex_unlock(info->camera_mutex);
+}
+
+int meshed_chunk_compare(const void *a, const void *b) {
+    const struct MeshedChunk *meshed_chunk_a = a;
+    const struct MeshedChunk *meshed_chunk_b = b;
+
+    return meshing_job_compare(&meshed_chunk_a->job, &meshed_chunk_b->job);
+}
+
+// Only the newest mesh of each chunk is kept, older ones are discarded and their meshers are freed.
+void meshing_info_add_pending_upload(struct MeshingInfo *info, struct MeshedChunk meshed_chunk) {
+    for (size_t i = 0; i < info->pending_uploads.length; i++) {
+        struct MeshedChunk *pending_upload = &info->pending_uploads.data[i];
+        if (pending_upload->job.chunk_i != meshed_chunk.job.chunk_i) {
+            continue;
+        }
+
+        info->meshers[pending_upload->mesher_i].processed_chunk_i = -1;
+        queue_push_uint32_t(&info->free_meshers, pending_upload->mesher_i);
+        ++info->upload_stats.total_discard_count;
+
+        // Keep the edit flag so that the replacement isn't delayed by the upload budget.
+        meshed_chunk.job.is_edited = meshed_chunk.job.is_edited || pending_upload->job.is_edited;
+        *pending_upload = meshed_chunk;
+
         return;
     }
 
+    list_push_struct_MeshedChunk(&info->pending_uploads, meshed_chunk);
+}
+
+// Meshed chunks are taken from the meshing thread without locking the world, then uploaded in priority order until
+// this frame's upload budget is used up. Player edits are always uploaded right away. After uploading, meshers are
+// handed back without copying their buffers.
+void meshing_info_upload(struct MeshingInfo *info) {
+    TRACE_BEGIN("meshing_info_upload");
+    double start_time = glfwGetTime();
+    struct MeshedChunk meshed_chunk;
+
+    while (queue_pop_struct_MeshedChunk(&info->meshed_chunks, &meshed_chunk)) {
+        meshing_info_add_pending_upload(info, meshed_chunk);
+    }
+
+    // The camera may have moved since these chunks were meshed, so their priorities are updated.
+    for (size_t i = 0; i < info->pending_uploads.length; i++) {
+        struct MeshingJob *job = &info->pending_uploads.data[i].job;
+        struct Chunk *chunk = &info->world->chunks[job->chunk_i];
+        vec3s min = {{chunk->x, 0.0f, chunk->z}};
+        vec3s max = {{chunk->x + CHUNK_SIZE, chunk_height, chunk->z + CHUNK_SIZE}};
+        vec3s center = {{chunk->x + CHUNK_SIZE * 0.5f, info->camera_position.y, chunk->z + CHUNK_SIZE * 0.5f}};
+
+        job->is_visible = frustum_contains_box(&info->camera_frustum, min, max);
+        job->distance_squared = glms_vec3_distance2(info->camera_position, center);
+    }
+
+    qsort(info->pending_uploads.data, info->pending_uploads.length, sizeof(struct MeshedChunk), meshed_chunk_compare);
+
     size_t upload_count = 0;
-    for (size_t i = 0; i < mesher_count; i++) {
-        int32_t processed_chunk_i = info->meshers[i].processed_chunk_i;
-        if (processed_chunk_i != -1) {
-            ++upload_count;
-            mesh_destroy(&info->meshes[processed_chunk_i]);
-            info->meshes[processed_chunk_i] =
-                mesh_create(info->meshers[i].vertices.data, info->meshers[i].vertices.length / vertex_component_count,
-                    info->meshers[i].indices.data, info->meshers[i].indices.length);
-            info->meshers[i].processed_chunk_i = -1;
+    size_t upload_bytes = 0;
+
+    for (; upload_count < info->pending_uploads.length; upload_count++) {
+        struct MeshedChunk *pending_upload = &info->pending_uploads.data[upload_count];
+        struct Mesher *mesher = &info->meshers[pending_upload->mesher_i];
+        int32_t processed_chunk_i = mesher->processed_chunk_i;
+
+        size_t mesh_bytes = mesher->vertices.length * sizeof(float) + mesher->indices.length * sizeof(uint32_t);
+        bool is_over_budget = upload_bytes + mesh_bytes > upload_byte_budget ||
+                              glfwGetTime() - start_time > upload_time_budget;
+
+        // At least one mesh is uploaded each frame, so that large meshes can't get stuck.
+        if (upload_count > 0 && is_over_budget && !pending_upload->job.is_edited) {
+            break;
         }
-    }
 
-    if (upload_count != 0) {
-        printf("Uploaded %zu meshes\n", upload_count);
+        buffer_arena_update(&info->arena, &info->allocations[processed_chunk_i], mesher->vertices.data,
+            mesher->vertices.length / vertex_component_count, mesher->indices.data, mesher->indices.length);
+        memcpy(&info->sections[SECTION_INDEX(processed_chunk_i, 0)], mesher->sections, sizeof(mesher->sections));
+        memcpy(&info->section_visibility[SECTION_INDEX(processed_chunk_i, 0)], mesher->section_visibility,
+            sizeof(mesher->section_visibility));
+
+        upload_bytes += mesh_bytes;
+        mesher->processed_chunk_i = -1;
+        queue_push_uint32_t(&info->free_meshers, pending_upload->mesher_i);
     }
 
-    ReleaseMutex(info->world->mutex);
+    // Remove the uploaded chunks from the front of the list, the rest wait for the next frame.
+    info->pending_uploads.length -= upload_count;
+    memmove(info->pending_uploads.data, info->pending_uploads.data + upload_count,
+        info->pending_uploads.length * sizeof(struct MeshedChunk));
+
+    info->upload_stats.upload_count = upload_count;
+    info->upload_stats.upload_bytes = upload_bytes;
+    info->upload_stats.upload_time = glfwGetTime() - start_time;
+    info->upload_stats.pending_count = info->pending_uploads.length;
+    info->upload_stats.total_upload_count += upload_count;
+    info->upload_stats.total_upload_bytes += upload_bytes;
+
+    TRACE_COUNTER("pending_uploads", info->pending_uploads.length);
+    TRACE_COUNTER("upload_bytes", upload_bytes);
+    TRACE_END("meshing_info_upload");
 }
 
-void meshing_info_draw(struct MeshingInfo *info) {
-    for (size_t i = 0; i < world_length; i++) {
-        mesh_draw(&info->meshes[i]);
+// Every section that is inside of the frustum and not hidden behind solid sections is drawn with one draw call.
+void meshing_info_draw(struct MeshingInfo *info, struct Frustum *frustum, vec3s camera_position) {
+    frustum_cull_boxes(frustum, &info->section_bounds, info->is_section_in_frustum);
+    visibility_find_visible_sections(info->section_visibility, info->is_section_in_frustum, camera_position,
+        &info->visibility_steps, info->is_section_visible);
+
+    draw_batch_begin(&info->draw_batch);
+
+    for (size_t chunk_i = 0; chunk_i < world_length; chunk_i++) {
+        for (int32_t section_y = 0; section_y < CHUNK_SECTION_COUNT; section_y++) {
+            size_t section_i = SECTION_INDEX(chunk_i, section_y);
+            if (!info->is_section_visible[section_i]) {
+                continue;
+            }
+
+            struct MeshSection *section = &info->sections[section_i];
+            draw_batch_add(
+                &info->draw_batch, &info->allocations[chunk_i], section->first_index, section->index_count);
+        }
     }
+
+    draw_batch_draw(&info->draw_batch, &info->arena);
 }
 
 void meshing_info_destroy(struct MeshingInfo *info) {
-    for (size_t i = 0; i < world_length; i++) {
-        mesh_destroy(&info->meshes[i]);
-    }
+    buffer_arena_destroy(&info->arena);
+    draw_batch_destroy(&info->draw_batch);
+    packed_boxes_destroy(&info->section_bounds);
+    list_destroy_struct_VisibilityStep(&info->visibility_steps);
 
     for (size_t i = 0; i < mesher_count; i++) {
         mesher_destroy(&info->meshers[i]);
     }
 
-    free(info->meshes);
+    mutex_destroy(info->camera_mutex);
+    condition_destroy(info->work_condition);
+    list_destroy_struct_MeshingJob(&info->jobs);
+
+    queue_destroy_uint32_t(&info->free_meshers);
+    queue_destroy_struct_MeshedChunk(&info->meshed_chunks);
+    list_destroy_struct_MeshedChunk(&info->pending_uploads);
+
+    free(info->allocations);
+    free(info->chunk_lods);
+    free(info->sections);
+    free(info->section_visibility);
+    free(info->is_section_in_frustum);
+    free(info->is_section_visible);
     free(info->meshers);
     free(info->light_level_cache);
 }
\ No newline at end of file
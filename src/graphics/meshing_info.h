@@ -4,29 +4,96 @@
 #include "../chunk.h"
 #include "../world.h"
 #include "../list.h"
+#include "../queue.h"
+#include "../frustum.h"
+#include "../visibility.h"
+#include "../thread.h"
 #include "mesher.h"
+#include "buffer_arena.h"
+#include "draw_batch.h"
+
+#include <cglm/struct.h>
 
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdatomic.h>
 
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
+struct MeshingJob {
+    int32_t chunk_i;
+    bool is_edited;
+    bool is_visible;
+    float distance_squared;
+};
+
+typedef struct MeshingJob struct_MeshingJob;
+LIST_DEFINE(struct_MeshingJob)
+
+// A mesher that has finished meshing, along with the job it was given.
+struct MeshedChunk {
+    uint32_t mesher_i;
+    struct MeshingJob job;
+};
+
+typedef struct MeshedChunk struct_MeshedChunk;
+LIST_DEFINE(struct_MeshedChunk)
+QUEUE_DEFINE(struct_MeshedChunk)
+
+struct MeshUploadStats {
+    // Counted over the most recent call to meshing_info_upload.
+    size_t upload_count;
+    size_t upload_bytes;
+    double upload_time;
+    size_t pending_count;
+    // Counted over the lifetime of the meshing info.
+    size_t total_upload_count;
+    size_t total_upload_bytes;
+    // Meshes that were replaced by a newer mesh of the same chunk before they could be uploaded.
+    size_t total_discard_count;
+};
 
 struct MeshingInfo {
     struct World *world;
-    struct Mesh *meshes;
+    struct List_struct_MeshingJob jobs;
+    // The camera is written by the main thread and read by the meshing thread to prioritize jobs.
+    struct Mutex *camera_mutex;
+    vec3s camera_position;
+    struct Frustum camera_frustum;
+    // Signalled with the camera mutex held whenever there may be new work, the meshing thread waits on it while idle.
+    struct Condition *work_condition;
+    bool has_new_work;
+    // Every chunk's mesh is stored in the arena, chunks without a mesh have an empty allocation.
+    struct BufferArena arena;
+    struct BufferArenaAllocation *allocations;
+    // The level of detail each chunk is meshed at, only written by the meshing thread.
+    int32_t *chunk_lods;
+    struct DrawBatch draw_batch;
+    // Section data is indexed with SECTION_INDEX.
+    struct MeshSection *sections;
+    uint16_t *section_visibility;
+    struct PackedBoxes section_bounds;
+    bool *is_section_in_frustum;
+    bool *is_section_visible;
+    struct List_struct_VisibilityStep visibility_steps;
     struct Mesher *meshers;
+    // Meshers are passed between threads by index, whichever thread popped a mesher owns its buffers.
+    // The meshing thread pops free meshers and pushes meshed ones, the main thread does the opposite.
+    struct Queue_uint32_t free_meshers;
+    struct Queue_struct_MeshedChunk meshed_chunks;
+    // Meshed chunks that didn't fit in a previous frame's upload budget, owned by the main thread.
+    struct List_struct_MeshedChunk pending_uploads;
+    struct MeshUploadStats upload_stats;
     uint8_t *light_level_cache;
     _Atomic(bool) is_done;
     int32_t texture_atlas_width;
     int32_t texture_atlas_height;
 };
 
-DWORD WINAPI meshing_thread_start(void *start_info);
+void meshing_thread_start(void *start_info);
 struct MeshingInfo meshing_info_create(struct World *world, int32_t texture_atlas_width, int32_t texture_atlas_height);
+void meshing_info_set_camera(struct MeshingInfo *info, vec3s position, struct Frustum *frustum);
+void meshing_info_stop(struct MeshingInfo *info);
 void meshing_info_upload(struct MeshingInfo *info);
-void meshing_info_draw(struct MeshingInfo *info);
+void meshing_info_draw(struct MeshingInfo *info, struct Frustum *frustum, vec3s camera_position);
 void meshing_info_destroy(struct MeshingInfo *info);
 
 #endif
\ No newline at end of file
@@ -1,16 +1,57 @@
 #include "resources.h"
 
 #include "../file.h"
+#include "../asset_pack.h"
+#include "texture_cache.h"
 
+#include <GLFW/glfw3.h>
+
+#include <assert.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <stb_image/stb_image.h>
 
-uint32_t shader_create(char *file_path, GLenum shader_type) {
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// Program binaries are newer than the OpenGL version glad was generated for, so they're loaded here if available.
+typedef void(APIENTRYP PFNGLGETPROGRAMBINARYPROC)(
+    GLuint program, GLsizei buf_size, GLsizei *length, GLenum *binary_format, void *binary);
+typedef void(APIENTRYP PFNGLPROGRAMBINARYPROC)(
+    GLuint program, GLenum binary_format, const void *binary, GLsizei length);
+typedef void(APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+static PFNGLGETPROGRAMBINARYPROC get_program_binary = NULL;
+static PFNGLPROGRAMBINARYPROC program_binary = NULL;
+static PFNGLPROGRAMPARAMETERIPROC program_parameter_i = NULL;
+static bool has_loaded_program_binary_functions = false;
+
+#define PROGRAM_CACHE_VERSION 1
+
+static const char program_cache_magic[4] = {'C', 'B', 'P', 'C'};
+
+// A program cache file is this header followed by the driver's binary for the linked program.
+struct ProgramCacheHeader {
+    char magic[4];
+    uint32_t version;
+    // A hash of the shader sources and the driver that produced the binary, the binary is only valid if it matches.
+    uint64_t key;
+    uint32_t binary_format;
+    uint32_t binary_length;
+};
+
+static uint32_t shader_create_from_source(const char *shader_source, char *file_path, GLenum shader_type) {
     uint32_t shader = glCreateShader(shader_type);
 
-    char *shader_source = get_file_string(file_path);
     glShaderSource(shader, 1, (const char *const *)&shader_source, NULL);
     glCompileShader(shader);
 
@@ -23,18 +64,30 @@ uint32_t shader_create(char *file_path, GLenum shader_type) {
         printf("Failed to compile shader (%s):\n%s\n", file_path, info_log);
     }
 
+    return shader;
+}
+
+uint32_t shader_create(char *file_path, GLenum shader_type) {
+    char *shader_source = get_file_string(file_path);
+    uint32_t shader = shader_create_from_source(shader_source, file_path, shader_type);
     free(shader_source);
 
     return shader;
 }
 
-uint32_t program_create(char *vertex_path, char *fragment_path) {
-    uint32_t vertex_shader = shader_create(vertex_path, GL_VERTEX_SHADER);
-    uint32_t fragment_shader = shader_create(fragment_path, GL_FRAGMENT_SHADER);
+static uint32_t program_create_from_source(const char *vertex_source, char *vertex_path, const char *fragment_source,
+    char *fragment_path, bool is_retrievable) {
+    uint32_t vertex_shader = shader_create_from_source(vertex_source, vertex_path, GL_VERTEX_SHADER);
+    uint32_t fragment_shader = shader_create_from_source(fragment_source, fragment_path, GL_FRAGMENT_SHADER);
 
     uint32_t program = glCreateProgram();
     glAttachShader(program, vertex_shader);
     glAttachShader(program, fragment_shader);
+
+    if (is_retrievable) {
+        program_parameter_i(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
     glLinkProgram(program);
 
     int32_t success;
@@ -52,6 +105,187 @@ uint32_t program_create(char *vertex_path, char *fragment_path) {
     return program;
 }
 
+uint32_t program_create(char *vertex_path, char *fragment_path) {
+    char *vertex_source = get_file_string(vertex_path);
+    char *fragment_source = get_file_string(fragment_path);
+
+    uint32_t program = program_create_from_source(vertex_source, vertex_path, fragment_source, fragment_path, false);
+
+    free(vertex_source);
+    free(fragment_source);
+
+    return program;
+}
+
+// FNV-1a, including the terminator so that adjacent strings can't run together.
+static uint64_t program_cache_hash_string(uint64_t hash, const char *string) {
+    do {
+        hash ^= (uint8_t)*string;
+        hash *= 0x100000001b3;
+    } while (*string++);
+
+    return hash;
+}
+
+static uint64_t program_cache_get_key(const char *vertex_source, const char *fragment_source) {
+    uint64_t hash = 0xcbf29ce484222325;
+    hash = program_cache_hash_string(hash, vertex_source);
+    hash = program_cache_hash_string(hash, fragment_source);
+    hash = program_cache_hash_string(hash, (const char *)glGetString(GL_VENDOR));
+    hash = program_cache_hash_string(hash, (const char *)glGetString(GL_RENDERER));
+    hash = program_cache_hash_string(hash, (const char *)glGetString(GL_VERSION));
+
+    return hash;
+}
+
+static bool program_cache_is_supported(void) {
+    if (!has_loaded_program_binary_functions) {
+        has_loaded_program_binary_functions = true;
+
+        if (glfwExtensionSupported("GL_ARB_get_program_binary")) {
+            get_program_binary = (PFNGLGETPROGRAMBINARYPROC)glfwGetProcAddress("glGetProgramBinary");
+            program_binary = (PFNGLPROGRAMBINARYPROC)glfwGetProcAddress("glProgramBinary");
+            program_parameter_i = (PFNGLPROGRAMPARAMETERIPROC)glfwGetProcAddress("glProgramParameteri");
+        }
+    }
+
+    if (!get_program_binary || !program_binary || !program_parameter_i) {
+        return false;
+    }
+
+    // Drivers can expose the extension without supporting any binary formats.
+    int32_t format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+
+    return format_count > 0;
+}
+
+// Returns 0 if the cache is missing, was built from different sources or by a different driver, or is rejected.
+static uint32_t program_cache_load(char *cache_path, uint64_t key) {
+    size_t file_length;
+    uint8_t *file_data = get_file_bytes(cache_path, &file_length);
+    if (!file_data) {
+        return 0;
+    }
+
+    struct ProgramCacheHeader header;
+    if (file_length < sizeof(header)) {
+        free(file_data);
+        return 0;
+    }
+
+    memcpy(&header, file_data, sizeof(header));
+    if (memcmp(header.magic, program_cache_magic, sizeof(program_cache_magic)) != 0 ||
+        header.version != PROGRAM_CACHE_VERSION || header.key != key ||
+        file_length != sizeof(header) + header.binary_length) {
+        free(file_data);
+        return 0;
+    }
+
+    uint32_t program = glCreateProgram();
+    program_binary(program, header.binary_format, file_data + sizeof(header), header.binary_length);
+    free(file_data);
+
+    // The driver may still reject a binary with a matching key, for example after an update that kept its version.
+    int32_t success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+    if (!success) {
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+static void program_cache_save(char *cache_path, uint64_t key, uint32_t program) {
+    int32_t binary_length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binary_length);
+    if (binary_length <= 0) {
+        return;
+    }
+
+    uint8_t *binary = malloc(binary_length);
+    assert(binary);
+
+    GLenum binary_format;
+    get_program_binary(program, binary_length, NULL, &binary_format, binary);
+
+    struct ProgramCacheHeader header = (struct ProgramCacheHeader){
+        .version = PROGRAM_CACHE_VERSION,
+        .key = key,
+        .binary_format = binary_format,
+        .binary_length = binary_length,
+    };
+    memcpy(header.magic, program_cache_magic, sizeof(program_cache_magic));
+
+    FILE *file = file_open(cache_path, "wb");
+    bool was_written = false;
+
+    if (file) {
+        was_written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                      fwrite(binary, 1, binary_length, file) == (size_t)binary_length;
+        was_written = fclose(file) == 0 && was_written;
+
+        // Don't leave a truncated cache behind, the program is compiled again on the next start instead.
+        if (!was_written) {
+            remove(cache_path);
+        }
+    }
+
+    if (!was_written) {
+        printf("Failed to write program cache: %s\n", cache_path);
+    }
+
+    free(binary);
+}
+
+// Load a linked program from the cache, or compile it and update the cache if that isn't possible. Shader sources are
+// read from the asset pack when it has them.
+uint32_t program_create_cached(
+    const struct AssetPack *asset_pack, char *cache_path, char *vertex_path, char *fragment_path) {
+    struct Asset vertex_asset;
+    struct Asset fragment_asset;
+    if (!asset_load(asset_pack, vertex_path, &vertex_asset)) {
+        printf("Failed to load shader: %s\n", vertex_path);
+        exit(-1);
+    }
+    if (!asset_load(asset_pack, fragment_path, &fragment_asset)) {
+        printf("Failed to load shader: %s\n", fragment_path);
+        exit(-1);
+    }
+
+    // Assets are always followed by a zero byte, so they can be used as strings directly.
+    const char *vertex_source = (const char *)vertex_asset.data;
+    const char *fragment_source = (const char *)fragment_asset.data;
+
+    bool is_cache_supported = program_cache_is_supported();
+    uint64_t key = 0;
+    uint32_t program = 0;
+
+    if (is_cache_supported) {
+        key = program_cache_get_key(vertex_source, fragment_source);
+        program = program_cache_load(cache_path, key);
+    }
+
+    if (!program) {
+        program = program_create_from_source(
+            vertex_source, vertex_path, fragment_source, fragment_path, is_cache_supported);
+
+        int32_t success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+        if (is_cache_supported && success) {
+            program_cache_save(cache_path, key, program);
+        }
+    }
+
+    asset_destroy(&vertex_asset);
+    asset_destroy(&fragment_asset);
+
+    return program;
+}
+
 struct Texture texture_create(char *file_path) {
     uint32_t texture;
     glGenTextures(1, &texture);
@@ -114,6 +348,102 @@ struct TextureArray texture_array_create(char **file_paths, size_t file_count, i
 
     glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
 
+    return (struct TextureArray){
+        .id = texture,
+        .width = width,
+        .height = height,
+        .layer_count = file_count,
+    };
+}
+
+// Upload every mip level of a cache to the bound texture, so there is no need to generate mipmaps at runtime.
+void texture_upload_cache(GLenum target, struct TextureCache *cache) {
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, cache->header.level_count - 1);
+
+    for (uint32_t level = 0; level < cache->header.level_count; level++) {
+        uint32_t level_width = texture_cache_get_level_width(cache, level);
+        uint32_t level_height = texture_cache_get_level_height(cache, level);
+        const uint8_t *level_data = texture_cache_get_level(cache, level);
+
+        if (target == GL_TEXTURE_2D_ARRAY) {
+            glTexImage3D(target, level, GL_RGBA, level_width, level_height, cache->header.layer_count, 0, GL_RGBA,
+                GL_UNSIGNED_BYTE, level_data);
+        } else {
+            glTexImage2D(target, level, GL_RGBA, level_width, level_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, level_data);
+        }
+    }
+}
+
+// View a texture cache from the asset pack or a loose file, the asset must outlive the cache.
+bool texture_cache_load_asset(
+    const struct AssetPack *asset_pack, char *cache_path, struct Asset *asset, struct TextureCache *cache) {
+    if (!asset_load(asset_pack, cache_path, asset)) {
+        return false;
+    }
+
+    if (!texture_cache_view(asset->data, asset->length, cache)) {
+        asset_destroy(asset);
+        return false;
+    }
+
+    return true;
+}
+
+// Load a texture from a cache built by texture_cache_builder, falling back to decoding the image if there isn't one.
+struct Texture texture_create_cached(const struct AssetPack *asset_pack, char *cache_path, char *file_path) {
+    struct Asset asset;
+    struct TextureCache cache;
+    if (!texture_cache_load_asset(asset_pack, cache_path, &asset, &cache)) {
+        printf("Texture cache is missing or out of date, loading image instead: %s\n", cache_path);
+        return texture_create(file_path);
+    } else if (cache.header.layer_count != 1) {
+        asset_destroy(&asset);
+        printf("Texture cache is missing or out of date, loading image instead: %s\n", cache_path);
+        return texture_create(file_path);
+    }
+
+    uint32_t texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    texture_upload_cache(GL_TEXTURE_2D, &cache);
+
+    struct Texture result = (struct Texture){
+        .id = texture,
+        .width = cache.header.width,
+        .height = cache.header.height,
+    };
+
+    asset_destroy(&asset);
+
+    return result;
+}
+
+struct TextureArray texture_array_create_cached(const struct AssetPack *asset_pack, char *cache_path,
+    char **file_paths, size_t file_count, int32_t width, int32_t height) {
+    struct Asset asset;
+    struct TextureCache cache;
+    if (!texture_cache_load_asset(asset_pack, cache_path, &asset, &cache)) {
+        printf("Texture cache is missing or out of date, loading images instead: %s\n", cache_path);
+        return texture_array_create(file_paths, file_count, width, height);
+    } else if (cache.header.layer_count != file_count || cache.header.width != (uint32_t)width ||
+               cache.header.height != (uint32_t)height) {
+        asset_destroy(&asset);
+        printf("Texture cache is missing or out of date, loading images instead: %s\n", cache_path);
+        return texture_array_create(file_paths, file_count, width, height);
+    }
+
+    uint32_t texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    texture_upload_cache(GL_TEXTURE_2D_ARRAY, &cache);
+
+    asset_destroy(&asset);
+
     return (struct TextureArray){
         .id = texture,
         .width = width,
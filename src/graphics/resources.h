@@ -3,6 +3,8 @@
 
 #include "../detect_leak.h"
 
+#include "../asset_pack.h"
+
 #include <inttypes.h>
 #include <glad/glad.h>
 
@@ -21,7 +23,12 @@ struct TextureArray {
 
 uint32_t shader_create(char *file_path, GLenum shader_type);
 uint32_t program_create(char *vertex_path, char *fragment_path);
+uint32_t program_create_cached(
+    const struct AssetPack *asset_pack, char *cache_path, char *vertex_path, char *fragment_path);
 struct Texture texture_create(char *file_path);
 struct TextureArray texture_array_create(char **file_paths, size_t file_count, int32_t width, int32_t height);
+struct Texture texture_create_cached(const struct AssetPack *asset_pack, char *cache_path, char *file_path);
+struct TextureArray texture_array_create_cached(const struct AssetPack *asset_pack, char *cache_path,
+    char **file_paths, size_t file_count, int32_t width, int32_t height);
 
 #endif
\ No newline at end of file
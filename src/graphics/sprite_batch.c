@@ -1,31 +1,86 @@
 #include "sprite_batch.h"
 
-#include <cglm/struct.h>
+#include <stdlib.h>
 
 #define SPRITE_TEXTURE_PADDING 0.01f
 
-const vec3s sprite_vertices[4] = {
-    {{0, 0, 0}},
-    {{0, 1, 0}},
-    {{1, 1, 0}},
-    {{1, 0, 0}},
-};
+// How long to wait for the GPU to release a segment before checking again, in nanoseconds.
+const GLuint64 sprite_batch_fence_timeout = 1000000;
 
-const vec2s sprite_uvs[4] = {
-    {{0, 1}},
-    {{0, 0}},
-    {{1, 0}},
-    {{1, 1}},
-};
+struct SpriteMaterial sprite_material_create(uint32_t program, struct Texture texture) {
+    return (struct SpriteMaterial){
+        .program = program,
+        .projection_matrix_location = glGetUniformLocation(program, "projection_matrix"),
+        .texture = texture,
+    };
+}
+
+// Point the instance attributes at the given instance of the buffer, there is no base instance in GL 3.3.
+void sprite_batch_set_instance_attributes(size_t first_instance) {
+    const size_t offset = first_instance * sizeof(struct SpriteInstance);
+    const GLsizei stride = sizeof(struct SpriteInstance);
+
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (void *)(offset + offsetof(struct SpriteInstance, rect)));
+    glVertexAttribPointer(
+        1, 4, GL_FLOAT, GL_FALSE, stride, (void *)(offset + offsetof(struct SpriteInstance, uv_rect)));
+    glVertexAttribPointer(
+        2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *)(offset + offsetof(struct SpriteInstance, color)));
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, stride, (void *)(offset + offsetof(struct SpriteInstance, layer)));
+}
+
+void sprite_batch_wait_for_segment(struct SpriteBatch *sprite_batch, size_t segment_i) {
+    GLsync fence = sprite_batch->segment_fences[segment_i];
+    if (!fence) {
+        return;
+    }
+
+    GLenum wait_result;
+    do {
+        wait_result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, sprite_batch_fence_timeout);
+    } while (wait_result == GL_TIMEOUT_EXPIRED);
 
-const uint32_t sprite_indices[] = {0, 2, 1, 0, 3, 2};
+    glDeleteSync(fence);
+    sprite_batch->segment_fences[segment_i] = NULL;
+}
+
+// Give every segment room for the given number of sprites. The old storage is orphaned, so this only has to wait for
+// the GPU once every in-flight segment's fence has been released.
+void sprite_batch_reserve(struct SpriteBatch *sprite_batch, size_t segment_capacity) {
+    for (size_t i = 0; i < SPRITE_BATCH_SEGMENT_COUNT; i++) {
+        sprite_batch_wait_for_segment(sprite_batch, i);
+    }
+
+    sprite_batch->segment_capacity = segment_capacity;
+
+    glBindBuffer(GL_ARRAY_BUFFER, sprite_batch->vbo);
+    glBufferData(GL_ARRAY_BUFFER, SPRITE_BATCH_SEGMENT_COUNT * segment_capacity * sizeof(struct SpriteInstance), NULL,
+        GL_STREAM_DRAW);
+}
 
 struct SpriteBatch sprite_batch_create(int capacity) {
-    return (struct SpriteBatch){
+    struct SpriteBatch sprite_batch = (struct SpriteBatch){
         .sprites = list_create_struct_Sprite(capacity),
-        .vertices = list_create_float(capacity * vertex_component_count),
-        .indices = list_create_uint32_t(capacity * 6),
+        .draws = list_create_struct_SpriteDraw(1),
+        .segment_i = 0,
+        .segment_fences = {NULL},
     };
+
+    glGenVertexArrays(1, &sprite_batch.vao);
+    glGenBuffers(1, &sprite_batch.vbo);
+
+    sprite_batch_reserve(&sprite_batch, capacity);
+
+    glBindVertexArray(sprite_batch.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, sprite_batch.vbo);
+
+    for (uint32_t i = 0; i < 4; i++) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+
+    sprite_batch_set_instance_attributes(0);
+
+    return sprite_batch;
 }
 
 void sprite_batch_begin(struct SpriteBatch *sprite_batch) {
@@ -33,64 +88,141 @@ void sprite_batch_begin(struct SpriteBatch *sprite_batch) {
 }
 
 void sprite_batch_add(struct SpriteBatch *sprite_batch, struct Sprite sprite) {
+    assert(sprite.material);
     list_push_struct_Sprite(&sprite_batch->sprites, sprite);
 }
 
-void sprite_batch_end(struct SpriteBatch *sprite_batch, int32_t texture_atlas_width, int32_t texture_atlas_height) {
-    mesh_destroy(&sprite_batch->mesh);
-    list_reset_float(&sprite_batch->vertices);
-    list_reset_uint32_t(&sprite_batch->indices);
+// Order sprites by program and then by texture, so that each is bound as few times as possible.
+int sprite_compare(const void *a, const void *b) {
+    const struct SpriteMaterial *material_a = ((const struct Sprite *)a)->material;
+    const struct SpriteMaterial *material_b = ((const struct Sprite *)b)->material;
 
-    const float inv_texture_width = 1.0f / texture_atlas_width;
-    const float inv_texture_height = 1.0f / texture_atlas_height;
+    if (material_a->program != material_b->program) {
+        return material_a->program < material_b->program ? -1 : 1;
+    }
 
-    for (size_t i = 0; i < sprite_batch->sprites.length; i++) {
-        struct Sprite *sprite = &sprite_batch->sprites.data[i];
+    if (material_a->texture.id != material_b->texture.id) {
+        return material_a->texture.id < material_b->texture.id ? -1 : 1;
+    }
 
-        uint32_t vertex_count = sprite_batch->vertices.length / vertex_component_count;
+    return 0;
+}
 
-        for (size_t index_i = 0; index_i < 6; index_i++) {
-            uint32_t index = vertex_count + sprite_indices[index_i];
-            list_push_uint32_t(&sprite_batch->indices, index);
-        }
+bool sprite_material_equals(const struct SpriteMaterial *a, const struct SpriteMaterial *b) {
+    return a->program == b->program && a->texture.id == b->texture.id;
+}
 
-        for (size_t vertex_i = 0; vertex_i < 4; vertex_i++) {
-            // Position:
-            float vertex_x = sprite->x + sprite_vertices[vertex_i].x * sprite->width;
-            float vertex_y = sprite->y + sprite_vertices[vertex_i].y * sprite->height;
-            float vertex_z = sprite->z + sprite_vertices[vertex_i].z;
-            list_push_float(&sprite_batch->vertices, vertex_x);
-            list_push_float(&sprite_batch->vertices, vertex_y);
-            list_push_float(&sprite_batch->vertices, vertex_z);
-
-            // Color:
-            list_push_float(&sprite_batch->vertices, 1.0f);
-            list_push_float(&sprite_batch->vertices, 1.0f);
-            list_push_float(&sprite_batch->vertices, 1.0f);
-
-            // UV:
-            float u = sprite->texture_x + SPRITE_TEXTURE_PADDING +
-                      sprite_uvs[vertex_i].u * (sprite->texture_width - SPRITE_TEXTURE_PADDING);
-            float v = sprite->texture_y + SPRITE_TEXTURE_PADDING +
-                      sprite_uvs[vertex_i].v * (sprite->texture_height - SPRITE_TEXTURE_PADDING);
-            list_push_float(&sprite_batch->vertices, u * inv_texture_width);
-            list_push_float(&sprite_batch->vertices, v * inv_texture_height);
-            list_push_float(&sprite_batch->vertices, 0.0f);
+// Sort the batch's sprites into draws and write their instances straight into the next segment of the buffer.
+void sprite_batch_end(struct SpriteBatch *sprite_batch) {
+    size_t sprite_count = sprite_batch->sprites.length;
+
+    if (sprite_count > sprite_batch->segment_capacity) {
+        sprite_batch_reserve(sprite_batch, GLM_MAX(sprite_batch->segment_capacity * 2, sprite_count));
+    }
+
+    sprite_batch->segment_i = (sprite_batch->segment_i + 1) % SPRITE_BATCH_SEGMENT_COUNT;
+    list_reset_struct_SpriteDraw(&sprite_batch->draws);
+
+    if (sprite_count == 0) {
+        return;
+    }
+
+    qsort(sprite_batch->sprites.data, sprite_count, sizeof(struct Sprite), sprite_compare);
+
+    sprite_batch_wait_for_segment(sprite_batch, sprite_batch->segment_i);
+
+    // The fence guarantees the GPU is done with this segment, so the driver doesn't need to synchronize the mapping.
+    size_t segment_offset = sprite_batch->segment_i * sprite_batch->segment_capacity * sizeof(struct SpriteInstance);
+    glBindBuffer(GL_ARRAY_BUFFER, sprite_batch->vbo);
+    struct SpriteInstance *instances = glMapBufferRange(GL_ARRAY_BUFFER, segment_offset,
+        sprite_count * sizeof(struct SpriteInstance),
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    assert(instances);
+
+    size_t first_instance = sprite_batch->segment_i * sprite_batch->segment_capacity;
+
+    for (size_t i = 0; i < sprite_count; i++) {
+        struct Sprite *sprite = &sprite_batch->sprites.data[i];
+        const struct Texture *texture = &sprite->material->texture;
+        const float inv_texture_width = 1.0f / texture->width;
+        const float inv_texture_height = 1.0f / texture->height;
+
+        instances[i] = (struct SpriteInstance){
+            .rect = {sprite->x, sprite->y, sprite->width, sprite->height},
+            .uv_rect =
+                {
+                    (sprite->texture_x + SPRITE_TEXTURE_PADDING) * inv_texture_width,
+                    (sprite->texture_y + SPRITE_TEXTURE_PADDING) * inv_texture_height,
+                    (sprite->texture_width - SPRITE_TEXTURE_PADDING) * inv_texture_width,
+                    (sprite->texture_height - SPRITE_TEXTURE_PADDING) * inv_texture_height,
+                },
+            .color =
+                {
+                    (uint8_t)(glm_clamp(sprite->color.x, 0.0f, 1.0f) * 255.0f),
+                    (uint8_t)(glm_clamp(sprite->color.y, 0.0f, 1.0f) * 255.0f),
+                    (uint8_t)(glm_clamp(sprite->color.z, 0.0f, 1.0f) * 255.0f),
+                    (uint8_t)(glm_clamp(sprite->color.w, 0.0f, 1.0f) * 255.0f),
+                },
+            .layer = sprite->z,
+        };
+
+        struct List_struct_SpriteDraw *draws = &sprite_batch->draws;
+        if (draws->length > 0 && sprite_material_equals(draws->data[draws->length - 1].material, sprite->material)) {
+            draws->data[draws->length - 1].instance_count++;
+        } else {
+            list_push_struct_SpriteDraw(draws, (struct SpriteDraw){
+                                                   .material = sprite->material,
+                                                   .first_instance = first_instance + i,
+                                                   .instance_count = 1,
+                                               });
         }
     }
 
-    sprite_batch->mesh =
-        mesh_create(sprite_batch->vertices.data, sprite_batch->vertices.length / vertex_component_count,
-            sprite_batch->indices.data, sprite_batch->indices.length);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
 }
 
-void sprite_batch_draw(struct SpriteBatch *sprite_batch) {
-    mesh_draw(&sprite_batch->mesh);
+void sprite_batch_draw(struct SpriteBatch *sprite_batch, mat4s projection_matrix) {
+    if (sprite_batch->draws.length == 0) {
+        return;
+    }
+
+    glBindVertexArray(sprite_batch->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, sprite_batch->vbo);
+
+    uint32_t bound_program = 0;
+    uint32_t bound_texture = 0;
+
+    for (size_t i = 0; i < sprite_batch->draws.length; i++) {
+        struct SpriteDraw *draw = &sprite_batch->draws.data[i];
+
+        if (draw->material->program != bound_program) {
+            bound_program = draw->material->program;
+            glUseProgram(bound_program);
+            glUniformMatrix4fv(
+                draw->material->projection_matrix_location, 1, GL_FALSE, (const float *)&projection_matrix);
+        }
+
+        if (draw->material->texture.id != bound_texture) {
+            bound_texture = draw->material->texture.id;
+            glBindTexture(GL_TEXTURE_2D, bound_texture);
+        }
+
+        // Each instance is expanded into a quad from gl_VertexID, so no per-vertex data is needed.
+        sprite_batch_set_instance_attributes(draw->first_instance);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, draw->instance_count);
+    }
+
+    sprite_batch->segment_fences[sprite_batch->segment_i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 }
 
 void sprite_batch_destroy(struct SpriteBatch *sprite_batch) {
-    mesh_destroy(&sprite_batch->mesh);
+    for (size_t i = 0; i < SPRITE_BATCH_SEGMENT_COUNT; i++) {
+        sprite_batch_wait_for_segment(sprite_batch, i);
+    }
+
+    glDeleteBuffers(1, &sprite_batch->vbo);
+    glDeleteVertexArrays(1, &sprite_batch->vao);
+
     list_destroy_struct_Sprite(&sprite_batch->sprites);
-    list_destroy_float(&sprite_batch->vertices);
-    list_destroy_uint32_t(&sprite_batch->indices);
-}
\ No newline at end of file
+    list_destroy_struct_SpriteDraw(&sprite_batch->draws);
+}
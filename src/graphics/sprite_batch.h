@@ -4,9 +4,23 @@
 #include "../detect_leak.h"
 
 #include "../list.h"
-#include "mesh.h"
+#include "resources.h"
+
+#include <cglm/struct.h>
+#include <glad/glad.h>
+
+// The number of frames that the GPU may still be reading sprites from while new sprites are written.
+#define SPRITE_BATCH_SEGMENT_COUNT 3
+
+// The program and texture that a sprite is drawn with. Sprites that share a material are drawn together.
+struct SpriteMaterial {
+    uint32_t program;
+    int32_t projection_matrix_location;
+    struct Texture texture;
+};
 
 struct Sprite {
+    const struct SpriteMaterial *material;
     float x;
     float y;
     float z;
@@ -16,24 +30,53 @@ struct Sprite {
     float texture_y;
     float texture_width;
     float texture_height;
+    vec4s color;
 };
 
 // Define a list of sprites, type names passed to LIST_DEFINE can't have spaces.
 typedef struct Sprite struct_Sprite;
 LIST_DEFINE(struct_Sprite)
 
+// The per-instance data for one sprite, expanded into a quad by the vertex shader.
+struct SpriteInstance {
+    // x, y, width, height
+    float rect[4];
+    // u, v, width, height in normalized texture coordinates.
+    float uv_rect[4];
+    uint8_t color[4];
+    float layer;
+};
+
+// A run of instances that share a material.
+struct SpriteDraw {
+    const struct SpriteMaterial *material;
+    size_t first_instance;
+    size_t instance_count;
+};
+
+typedef struct SpriteDraw struct_SpriteDraw;
+LIST_DEFINE(struct_SpriteDraw)
+
+// Sprites are streamed into an instance buffer that is split into one segment per frame. Each frame writes to the
+// next segment and places a fence after drawing it, so a segment is only rewritten once the GPU is done with it.
 struct SpriteBatch {
     struct List_struct_Sprite sprites;
-    struct List_float vertices;
-    struct List_uint32_t indices;
-    struct Mesh mesh;
+    struct List_struct_SpriteDraw draws;
+    uint32_t vao;
+    uint32_t vbo;
+    // The number of instances that fit in a segment.
+    size_t segment_capacity;
+    size_t segment_i;
+    GLsync segment_fences[SPRITE_BATCH_SEGMENT_COUNT];
 };
 
+struct SpriteMaterial sprite_material_create(uint32_t program, struct Texture texture);
+
 struct SpriteBatch sprite_batch_create(int capacity);
 void sprite_batch_begin(struct SpriteBatch *sprite_batch);
 void sprite_batch_add(struct SpriteBatch *sprite_batch, struct Sprite sprite);
-void sprite_batch_end(struct SpriteBatch *sprite_batch, int32_t texture_atlas_width, int32_t texture_atlas_height);
-void sprite_batch_draw(struct SpriteBatch *sprite_batch);
+void sprite_batch_end(struct SpriteBatch *sprite_batch);
+void sprite_batch_draw(struct SpriteBatch *sprite_batch, mat4s projection_matrix);
 void sprite_batch_destroy(struct SpriteBatch *sprite_batch);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,162 @@
+#include "texture_cache.h"
+
+#include "../file.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char texture_cache_magic[4] = {'C', 'B', 'T', 'C'};
+
+uint32_t texture_cache_get_level_count(uint32_t width, uint32_t height) {
+    uint32_t level_count = 1;
+
+    while (width > 1 || height > 1) {
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+        level_count++;
+    }
+
+    return level_count;
+}
+
+uint32_t texture_cache_get_level_width(struct TextureCache *cache, uint32_t level) {
+    uint32_t width = cache->header.width >> level;
+    return width > 0 ? width : 1;
+}
+
+uint32_t texture_cache_get_level_height(struct TextureCache *cache, uint32_t level) {
+    uint32_t height = cache->header.height >> level;
+    return height > 0 ? height : 1;
+}
+
+size_t texture_cache_get_level_length(struct TextureCache *cache, uint32_t level) {
+    return (size_t)texture_cache_get_level_width(cache, level) * texture_cache_get_level_height(cache, level) *
+           cache->header.layer_count * 4;
+}
+
+size_t texture_cache_get_data_length(struct TextureCache *cache) {
+    size_t data_length = 0;
+
+    for (uint32_t level = 0; level < cache->header.level_count; level++) {
+        data_length += texture_cache_get_level_length(cache, level);
+    }
+
+    return data_length;
+}
+
+const uint8_t *texture_cache_get_level(struct TextureCache *cache, uint32_t level) {
+    size_t offset = 0;
+
+    for (uint32_t i = 0; i < level; i++) {
+        offset += texture_cache_get_level_length(cache, i);
+    }
+
+    return cache->data + offset;
+}
+
+// Average each 2x2 block of texels in the source layer, clamping at the edges of odd sized levels.
+void texture_cache_downsample(const uint8_t *source, uint32_t source_width, uint32_t source_height,
+    uint8_t *destination, uint32_t destination_width, uint32_t destination_height) {
+    for (uint32_t y = 0; y < destination_height; y++) {
+        for (uint32_t x = 0; x < destination_width; x++) {
+            uint32_t x0 = x * 2 < source_width ? x * 2 : source_width - 1;
+            uint32_t y0 = y * 2 < source_height ? y * 2 : source_height - 1;
+            uint32_t x1 = x0 + 1 < source_width ? x0 + 1 : x0;
+            uint32_t y1 = y0 + 1 < source_height ? y0 + 1 : y0;
+
+            for (uint32_t channel = 0; channel < 4; channel++) {
+                uint32_t sum = source[(x0 + y0 * source_width) * 4 + channel] +
+                               source[(x1 + y0 * source_width) * 4 + channel] +
+                               source[(x0 + y1 * source_width) * 4 + channel] +
+                               source[(x1 + y1 * source_width) * 4 + channel];
+                destination[(x + y * destination_width) * 4 + channel] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+// Build a cache with a full mip chain from RGBA layers that all have the given size.
+struct TextureCache texture_cache_create(uint8_t **layers, uint32_t layer_count, uint32_t width, uint32_t height) {
+    struct TextureCache cache = (struct TextureCache){
+        .header =
+            {
+                .version = TEXTURE_CACHE_VERSION,
+                .width = width,
+                .height = height,
+                .layer_count = layer_count,
+                .level_count = texture_cache_get_level_count(width, height),
+            },
+    };
+    memcpy(cache.header.magic, texture_cache_magic, sizeof(texture_cache_magic));
+
+    cache.data_length = texture_cache_get_data_length(&cache);
+    cache.buffer = malloc(cache.data_length);
+    assert(cache.buffer);
+    cache.data = cache.buffer;
+
+    size_t layer_length = (size_t)width * height * 4;
+    for (uint32_t layer_i = 0; layer_i < layer_count; layer_i++) {
+        memcpy(cache.buffer + layer_i * layer_length, layers[layer_i], layer_length);
+    }
+
+    for (uint32_t level = 1; level < cache.header.level_count; level++) {
+        const uint8_t *source = texture_cache_get_level(&cache, level - 1);
+        uint8_t *destination = cache.buffer + (texture_cache_get_level(&cache, level) - cache.data);
+        uint32_t source_width = texture_cache_get_level_width(&cache, level - 1);
+        uint32_t source_height = texture_cache_get_level_height(&cache, level - 1);
+        uint32_t destination_width = texture_cache_get_level_width(&cache, level);
+        uint32_t destination_height = texture_cache_get_level_height(&cache, level);
+        size_t source_layer_length = (size_t)source_width * source_height * 4;
+        size_t destination_layer_length = (size_t)destination_width * destination_height * 4;
+
+        for (uint32_t layer_i = 0; layer_i < layer_count; layer_i++) {
+            texture_cache_downsample(source + layer_i * source_layer_length, source_width, source_height,
+                destination + layer_i * destination_layer_length, destination_width, destination_height);
+        }
+    }
+
+    return cache;
+}
+
+// View a cache file that is already in memory without copying its texels. Returns false if the data isn't a valid
+// cache of this version.
+bool texture_cache_view(const uint8_t *file_data, size_t file_length, struct TextureCache *cache) {
+    struct TextureCacheHeader header;
+    if (file_length < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, file_data, sizeof(header));
+    if (memcmp(header.magic, texture_cache_magic, sizeof(texture_cache_magic)) != 0 ||
+        header.version != TEXTURE_CACHE_VERSION || header.width == 0 || header.height == 0 ||
+        header.level_count != texture_cache_get_level_count(header.width, header.height)) {
+        return false;
+    }
+
+    *cache = (struct TextureCache){
+        .header = header,
+        .data = file_data + sizeof(header),
+    };
+    cache->data_length = texture_cache_get_data_length(cache);
+
+    return file_length == sizeof(header) + cache->data_length;
+}
+
+bool texture_cache_save(struct TextureCache *cache, char *file_path) {
+    FILE *file = file_open(file_path, "wb");
+
+    if (!file) {
+        return false;
+    }
+
+    bool was_written = fwrite(&cache->header, sizeof(cache->header), 1, file) == 1 &&
+                       fwrite(cache->data, 1, cache->data_length, file) == cache->data_length;
+
+    return fclose(file) == 0 && was_written;
+}
+
+void texture_cache_destroy(struct TextureCache *cache) {
+    free(cache->buffer);
+}
@@ -0,0 +1,42 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "../detect_leak.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TEXTURE_CACHE_VERSION 1
+
+// A texture cache file is a header followed by the RGBA texels of every mip level, largest first. Each level stores
+// all of its layers back to back, which is the layout glTexImage3D expects.
+struct TextureCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t layer_count;
+    uint32_t level_count;
+};
+
+struct TextureCache {
+    struct TextureCacheHeader header;
+    // The allocation holding the texels of a created cache. Views don't own their texels, so this is NULL for them.
+    uint8_t *buffer;
+    // Texels of every level.
+    const uint8_t *data;
+    size_t data_length;
+};
+
+uint32_t texture_cache_get_level_count(uint32_t width, uint32_t height);
+uint32_t texture_cache_get_level_width(struct TextureCache *cache, uint32_t level);
+uint32_t texture_cache_get_level_height(struct TextureCache *cache, uint32_t level);
+const uint8_t *texture_cache_get_level(struct TextureCache *cache, uint32_t level);
+
+struct TextureCache texture_cache_create(uint8_t **layers, uint32_t layer_count, uint32_t width, uint32_t height);
+bool texture_cache_view(const uint8_t *file_data, size_t file_length, struct TextureCache *cache);
+bool texture_cache_save(struct TextureCache *cache, char *file_path);
+void texture_cache_destroy(struct TextureCache *cache);
+
+#endif
@@ -16,7 +16,7 @@
         size_t length;                                                                                                 \
     };                                                                                                                 \
                                                                                                                        \
-    inline struct List_##type list_create_##type(size_t capacity) {                                                    \
+    static inline struct List_##type list_create_##type(size_t capacity) {                                             \
         struct List_##type list = (struct List_##type){                                                                \
             .data = malloc(capacity * sizeof(type)),                                                                   \
             .capacity = capacity,                                                                                      \
@@ -28,11 +28,11 @@
         return list;                                                                                                   \
     }                                                                                                                  \
                                                                                                                        \
-    inline void list_reset_##type(struct List_##type *list) {                                                          \
+    static inline void list_reset_##type(struct List_##type *list) {                                                   \
         list->length = 0;                                                                                              \
     }                                                                                                                  \
                                                                                                                        \
-    inline void list_push_##type(struct List_##type *list, type value) {                                               \
+    static inline void list_push_##type(struct List_##type *list, type value) {                                        \
         if (list->length >= list->capacity) {                                                                          \
             list->capacity *= 2;                                                                                       \
             list->data = realloc(list->data, list->capacity * sizeof(type));                                           \
@@ -43,7 +43,7 @@
         ++list->length;                                                                                                \
     }                                                                                                                  \
                                                                                                                        \
-    inline type list_pop_##type(struct List_##type *list) {                                                            \
+    static inline type list_pop_##type(struct List_##type *list) {                                                     \
         assert(list->length > 0);                                                                                      \
                                                                                                                        \
         --list->length;                                                                                                \
@@ -51,14 +51,14 @@
     }                                                                                                                  \
                                                                                                                        \
     /* Replace the ith element with the last element. Fast, but changes the list's order. */                           \
-    inline void list_remove_unordered_##type(struct List_##type *list, size_t i) {                                     \
+    static inline void list_remove_unordered_##type(struct List_##type *list, size_t i) {                              \
         assert(list->length > i);                                                                                      \
                                                                                                                        \
         --list->length;                                                                                                \
         list->data[i] = list->data[list->length];                                                                      \
     }                                                                                                                  \
                                                                                                                        \
-    inline void list_destroy_##type(struct List_##type *list) {                                                        \
+    static inline void list_destroy_##type(struct List_##type *list) {                                                 \
         free(list->data);                                                                                              \
     }
 
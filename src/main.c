@@ -3,6 +3,11 @@
 #include "window.h"
 #include "camera.h"
 #include "world.h"
+#include "frustum.h"
+#include "asset_pack.h"
+#include "profiler.h"
+#include "trace.h"
+#include "thread.h"
 #include "graphics/meshing_info.h"
 #include "graphics/resources.h"
 #include "graphics/sprite_batch.h"
@@ -14,11 +19,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <inttypes.h>
-
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
+#include <math.h>
 
 #define BLOCK_TEXTURE_COUNT 3
 
@@ -26,30 +30,53 @@ const float sky_color_r = 100.0f / 255.0f;
 const float sky_color_g = 149.0f / 255.0f;
 const float sky_color_b = 237.0f / 255.0f;
 
-int main() {
+// Passing --uncompressed saves chunks uncompressed, which a later run with --read-only can use straight from a mapping
+// of the world's region file. Nothing is saved with --read-only.
+int main(int argc, char **argv) {
+    enum RegionMode region_mode = REGION_MODE_COMPRESSED;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--uncompressed") == 0) {
+            region_mode = REGION_MODE_UNCOMPRESSED;
+        } else if (strcmp(argv[i], "--read-only") == 0) {
+            region_mode = REGION_MODE_MAPPED;
+        }
+    }
+
     struct Window window = window_create("CBlock", 640, 480);
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
 
-    uint32_t program_3d = program_create("assets/shader_3d.vert", "assets/shader_3d.frag");
-    uint32_t program_2d = program_create("assets/shader_2d.vert", "assets/shader_2d.frag");
+    // Assets missing from the pack, or all of them if there is no pack, are loaded from loose files instead.
+    struct AssetPack asset_pack = asset_pack_open("assets/assets.cbap");
 
+    uint32_t program_3d = program_create_cached(
+        &asset_pack, "assets/shader_3d.programcache", "assets/shader_3d.vert", "assets/shader_3d.frag");
+    uint32_t program_2d = program_create_cached(
+        &asset_pack, "assets/shader_2d.programcache", "assets/shader_2d.vert", "assets/shader_2d.frag");
+
+    // Keep in sync with the block texture cache in CMakeLists.txt.
     char *block_texture_paths[BLOCK_TEXTURE_COUNT] = {
         "assets/block_textures/dirt.png",
         "assets/block_textures/grass.png",
         "assets/block_textures/light.png",
     };
     // TODO: Add texture_bind and texture_destroy
-    struct TextureArray texture_atlas_3d = texture_array_create(block_texture_paths, BLOCK_TEXTURE_COUNT, 16, 16);
-    struct Texture texture_atlas_2d = texture_create("assets/texture_atlas.png");
+    struct TextureArray texture_atlas_3d = texture_array_create_cached(
+        &asset_pack, "assets/block_textures.cbtc", block_texture_paths, BLOCK_TEXTURE_COUNT, 16, 16);
+    struct Texture texture_atlas_2d =
+        texture_create_cached(&asset_pack, "assets/texture_atlas.cbtc", "assets/texture_atlas.png");
+
+    // Everything needed from the pack has been uploaded.
+    asset_pack_close(&asset_pack);
 
     const float cursor_size = 16.0f;
     float cursor_x = 0.0f;
     float cursor_y = 0.0f;
+    struct SpriteMaterial sprite_material_2d = sprite_material_create(program_2d, texture_atlas_2d);
     struct SpriteBatch sprite_batch = sprite_batch_create(16);
 
-    struct World world = world_create();
+    struct World world = world_create("world.cbrg", region_mode);
 
     struct Camera camera = camera_create();
     camera.position.y = chunk_height / 2 + 3;
@@ -64,19 +91,24 @@ int main() {
     int32_t projection_matrix_location_3d = glGetUniformLocation(program_3d, "projection_matrix");
     int32_t time_of_day_location_3d = glGetUniformLocation(program_3d, "time_of_day");
 
-    int32_t projection_matrix_location_2d = glGetUniformLocation(program_2d, "projection_matrix");
-
     double last_frame_time = glfwGetTime();
-    float fps_print_timer = 0.0f;
+    float profiler_print_timer = 0.0f;
+    struct Profiler profiler = profiler_create();
 
     float elapsed_time = 0.0f;
 
     struct MeshingInfo meshing_info = meshing_info_create(&world, texture_atlas_3d.width, texture_atlas_3d.height);
-    HANDLE meshing_thread = CreateThread(NULL, 0, meshing_thread_start, &meshing_info, 0, NULL);
-    assert(meshing_thread);
+    struct Thread *meshing_thread = thread_create(meshing_thread_start, &meshing_info);
+
+    TRACE_THREAD_NAME("main");
 
     while (!glfwWindowShouldClose(window.glfw_window)) {
+        TRACE_BEGIN("frame");
+        profiler_begin_frame(&profiler);
+
         // Update:
+        profiler_begin(&profiler, "update");
+
         if (window.was_resized) {
             glViewport(0, 0, window.width, window.height);
             projection_matrix_3d = glms_perspective(glm_rad(90.0), window.width / (float)window.height, 0.1f, 100.0f);
@@ -92,25 +124,39 @@ int main() {
         float delta_time = (float)(current_frame_time - last_frame_time);
         last_frame_time = current_frame_time;
 
-        fps_print_timer += delta_time;
+        profiler_print_timer += delta_time;
 
-        if (fps_print_timer > 1.0f) {
-            fps_print_timer = 0.0f;
-            printf("fps: %f\n", 1.0f / delta_time);
+        if (profiler_print_timer > 1.0f) {
+            profiler_print_timer = 0.0f;
+            profiler_print(&profiler);
         }
 
         elapsed_time += delta_time;
         float time_of_day = 0.5f * (sin(elapsed_time * 0.1f) + 1.0f);
 
+        vec3s previous_camera_position = camera.position;
+
+        profiler_begin(&profiler, "camera_move");
         camera_move(&camera, &window, &world, delta_time);
+        profiler_end(&profiler);
+
+        world_receive_chunks(&world);
+        world_prefetch_chunks(&world, camera.position, glms_vec3_sub(camera.position, previous_camera_position));
+        world_autosave(&world, delta_time);
+
         camera_rotate(&camera, &window);
         camera_interact(&camera, &window.input, &world);
         view_matrix = camera_get_view_matrix(&camera);
+        struct Frustum frustum = frustum_create(glms_mat4_mul(projection_matrix_3d, view_matrix));
+        meshing_info_set_camera(&meshing_info, camera.position, &frustum);
 
+        profiler_begin(&profiler, "meshing_info_upload");
         meshing_info_upload(&meshing_info);
+        profiler_end(&profiler);
 
         sprite_batch_begin(&sprite_batch);
         sprite_batch_add(&sprite_batch, (struct Sprite){
+                                            .material = &sprite_material_2d,
                                             .x = cursor_x,
                                             .y = cursor_y,
                                             .width = cursor_size,
@@ -118,10 +164,16 @@ int main() {
                                             .texture_y = cursor_size,
                                             .texture_width = cursor_size,
                                             .texture_height = cursor_size,
+                                            .color = {{1.0f, 1.0f, 1.0f, 1.0f}},
                                         });
-        sprite_batch_end(&sprite_batch, texture_atlas_2d.width, texture_atlas_2d.height);
+        sprite_batch_end(&sprite_batch);
+
+        profiler_end(&profiler);
 
         // Draw:
+        profiler_begin(&profiler, "draw");
+        profiler_begin_gpu(&profiler, "draw_3d");
+
         glClearColor(sky_color_r * time_of_day, sky_color_g * time_of_day, sky_color_b * time_of_day, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -130,27 +182,49 @@ int main() {
         glUniformMatrix4fv(projection_matrix_location_3d, 1, GL_FALSE, (const float *)&projection_matrix_3d);
         glUniform1f(time_of_day_location_3d, time_of_day);
         glBindTexture(GL_TEXTURE_2D_ARRAY, texture_atlas_3d.id);
-        meshing_info_draw(&meshing_info);
+        meshing_info_draw(&meshing_info, &frustum, camera.position);
+
+        profiler_end_gpu(&profiler);
+        profiler_begin_gpu(&profiler, "draw_2d");
 
-        glUseProgram(program_2d);
-        glUniformMatrix4fv(projection_matrix_location_2d, 1, GL_FALSE, (const float *)&projection_matrix_2d);
-        glBindTexture(GL_TEXTURE_2D, texture_atlas_2d.id);
-        sprite_batch_draw(&sprite_batch);
+        sprite_batch_draw(&sprite_batch, projection_matrix_2d);
+
+        profiler_end_gpu(&profiler);
+        profiler_end(&profiler);
 
         window_update(&window);
 
+        profiler_begin(&profiler, "swap");
         glfwSwapBuffers(window.glfw_window);
+        profiler_end(&profiler);
+
         glfwPollEvents();
+
+        profiler_end_frame(&profiler);
+        TRACE_END("frame");
+
+        if (input_is_button_pressed(&window.input, GLFW_KEY_F9)) {
+            TRACE_WRITE("trace.json");
+        }
+
+        if (input_is_button_pressed(&window.input, GLFW_KEY_F5) && !world_backup(&world, "world_backup.cbrg")) {
+            printf("Failed to back up the world\n");
+        }
     }
 
-    meshing_info.is_done = true;
-    WaitForSingleObject(meshing_thread, INFINITE);
-    CloseHandle(meshing_thread);
+    meshing_info_stop(&meshing_info);
+    thread_join(meshing_thread);
     meshing_info_destroy(&meshing_info);
 
+    profiler_destroy(&profiler);
+
     sprite_batch_destroy(&sprite_batch);
     world_destroy(&world);
 
+    // Destroying the world saves it and joins the I/O threads, which record events until then.
+    TRACE_WRITE("trace.json");
+    TRACE_DESTROY();
+
     glDeleteTextures(1, &texture_atlas_3d.id);
     glDeleteTextures(1, &texture_atlas_2d.id);
 
@@ -158,7 +232,9 @@ int main() {
 
     window_destroy(&window);
 
+#ifdef _MSC_VER
     printf("Found leaks: %s\n", _CrtDumpMemoryLeaks() ? "true" : "false");
+#endif
 
     return 0;
 }
@@ -0,0 +1,212 @@
+#include "profiler.h"
+
+#include <assert.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct Profiler profiler_create(void) {
+    return (struct Profiler){
+        .scope_count = 0,
+        .scope_stack_length = 0,
+        .gpu_scope_i = -1,
+        .frame_i = 0,
+    };
+}
+
+// Find the scope with this name and parent, creating it the first time it's run.
+int32_t profiler_get_scope(struct Profiler *profiler, const char *name, int32_t parent_i, bool is_gpu) {
+    for (size_t i = 0; i < profiler->scope_count; i++) {
+        struct ProfilerScope *scope = &profiler->scopes[i];
+
+        if (scope->parent_i == parent_i && scope->is_gpu == is_gpu && strcmp(scope->name, name) == 0) {
+            return i;
+        }
+    }
+
+    assert(profiler->scope_count < PROFILER_MAX_SCOPES);
+
+    int32_t scope_i = profiler->scope_count++;
+    profiler->scopes[scope_i] = (struct ProfilerScope){
+        .name = name,
+        .parent_i = parent_i,
+        .depth = parent_i == -1 ? 0 : profiler->scopes[parent_i].depth + 1,
+        .is_gpu = is_gpu,
+    };
+
+    if (is_gpu) {
+        glGenQueries(PROFILER_QUERY_COUNT, profiler->scopes[scope_i].queries);
+    }
+
+    return scope_i;
+}
+
+void profiler_push_sample(struct ProfilerScope *scope, float sample) {
+    scope->samples[scope->next_sample_i] = sample;
+    scope->next_sample_i = (scope->next_sample_i + 1) % PROFILER_SAMPLE_COUNT;
+
+    if (scope->sample_count < PROFILER_SAMPLE_COUNT) {
+        scope->sample_count++;
+    }
+}
+
+void profiler_read_query(struct ProfilerScope *scope, size_t query_i) {
+    uint64_t elapsed_nanoseconds;
+    glGetQueryObjectui64v(scope->queries[query_i], GL_QUERY_RESULT, &elapsed_nanoseconds);
+    scope->is_query_pending[query_i] = false;
+
+    profiler_push_sample(scope, elapsed_nanoseconds / 1000000.0f);
+}
+
+void profiler_begin_frame(struct Profiler *profiler) {
+    for (size_t i = 0; i < profiler->scope_count; i++) {
+        profiler->scopes[i].frame_time = 0.0;
+        profiler->scopes[i].was_run = false;
+    }
+
+    profiler_begin(profiler, "frame");
+}
+
+// Record the time of every CPU scope that ran this frame, and collect any GPU timings that have become available.
+void profiler_end_frame(struct Profiler *profiler) {
+    profiler_end(profiler);
+    assert(profiler->scope_stack_length == 0);
+    assert(profiler->gpu_scope_i == -1);
+
+    for (size_t i = 0; i < profiler->scope_count; i++) {
+        struct ProfilerScope *scope = &profiler->scopes[i];
+
+        if (!scope->is_gpu) {
+            if (scope->was_run) {
+                profiler_push_sample(scope, (float)(scope->frame_time * 1000.0));
+            }
+
+            continue;
+        }
+
+        for (size_t query_i = 0; query_i < PROFILER_QUERY_COUNT; query_i++) {
+            if (!scope->is_query_pending[query_i]) {
+                continue;
+            }
+
+            int32_t is_available;
+            glGetQueryObjectiv(scope->queries[query_i], GL_QUERY_RESULT_AVAILABLE, &is_available);
+
+            if (is_available) {
+                profiler_read_query(scope, query_i);
+            }
+        }
+    }
+
+    profiler->frame_i++;
+}
+
+void profiler_begin(struct Profiler *profiler, const char *name) {
+    assert(profiler->scope_stack_length < PROFILER_MAX_SCOPES);
+
+    int32_t parent_i =
+        profiler->scope_stack_length > 0 ? profiler->scope_stack[profiler->scope_stack_length - 1] : -1;
+    int32_t scope_i = profiler_get_scope(profiler, name, parent_i, false);
+
+    profiler->scope_stack[profiler->scope_stack_length++] = scope_i;
+    profiler->scopes[scope_i].start_time = glfwGetTime();
+}
+
+void profiler_end(struct Profiler *profiler) {
+    assert(profiler->scope_stack_length > 0);
+
+    int32_t scope_i = profiler->scope_stack[--profiler->scope_stack_length];
+    struct ProfilerScope *scope = &profiler->scopes[scope_i];
+
+    // A scope may run more than once in a frame, its sample is the total.
+    scope->frame_time += glfwGetTime() - scope->start_time;
+    scope->was_run = true;
+}
+
+void profiler_begin_gpu(struct Profiler *profiler, const char *name) {
+    assert(profiler->gpu_scope_i == -1);
+
+    int32_t scope_i = profiler_get_scope(profiler, name, -1, true);
+    struct ProfilerScope *scope = &profiler->scopes[scope_i];
+    size_t query_i = profiler->frame_i % PROFILER_QUERY_COUNT;
+
+    // Only wait for the GPU if it has fallen further behind than the ring can hold.
+    if (scope->is_query_pending[query_i]) {
+        profiler_read_query(scope, query_i);
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, scope->queries[query_i]);
+    scope->is_query_pending[query_i] = true;
+    profiler->gpu_scope_i = scope_i;
+}
+
+void profiler_end_gpu(struct Profiler *profiler) {
+    assert(profiler->gpu_scope_i != -1);
+
+    glEndQuery(GL_TIME_ELAPSED);
+    profiler->gpu_scope_i = -1;
+}
+
+int profiler_sample_compare(const void *a, const void *b) {
+    float sample_a = *(const float *)a;
+    float sample_b = *(const float *)b;
+
+    return (sample_a > sample_b) - (sample_a < sample_b);
+}
+
+struct ProfilerStats profiler_get_stats(struct ProfilerScope *scope) {
+    if (scope->sample_count == 0) {
+        return (struct ProfilerStats){0};
+    }
+
+    float sorted_samples[PROFILER_SAMPLE_COUNT];
+    memcpy(sorted_samples, scope->samples, scope->sample_count * sizeof(float));
+    qsort(sorted_samples, scope->sample_count, sizeof(float), profiler_sample_compare);
+
+    float sum = 0.0f;
+    for (size_t i = 0; i < scope->sample_count; i++) {
+        sum += sorted_samples[i];
+    }
+
+    size_t p99_i = (scope->sample_count * 99 + 99) / 100 - 1;
+
+    return (struct ProfilerStats){
+        .min = sorted_samples[0],
+        .mean = sum / scope->sample_count,
+        .p99 = sorted_samples[p99_i],
+        .max = sorted_samples[scope->sample_count - 1],
+    };
+}
+
+void profiler_print_scope(struct ProfilerScope *scope) {
+    struct ProfilerStats stats = profiler_get_stats(scope);
+
+    printf("%s%*s%-*s %8.3f %8.3f %8.3f %8.3f\n", scope->is_gpu ? "gpu " : "    ", scope->depth * 2, "",
+        24 - scope->depth * 2, scope->name, stats.min, stats.mean, stats.p99, stats.max);
+}
+
+// Print each scope's statistics in milliseconds, with CPU scopes indented under their parents.
+void profiler_print(struct Profiler *profiler) {
+    printf("    %-24s %8s %8s %8s %8s\n", "scope (ms)", "min", "mean", "p99", "max");
+
+    for (size_t i = 0; i < profiler->scope_count; i++) {
+        if (!profiler->scopes[i].is_gpu) {
+            profiler_print_scope(&profiler->scopes[i]);
+        }
+    }
+
+    for (size_t i = 0; i < profiler->scope_count; i++) {
+        if (profiler->scopes[i].is_gpu) {
+            profiler_print_scope(&profiler->scopes[i]);
+        }
+    }
+}
+
+void profiler_destroy(struct Profiler *profiler) {
+    for (size_t i = 0; i < profiler->scope_count; i++) {
+        if (profiler->scopes[i].is_gpu) {
+            glDeleteQueries(PROFILER_QUERY_COUNT, profiler->scopes[i].queries);
+        }
+    }
+}
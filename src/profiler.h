@@ -0,0 +1,65 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "detect_leak.h"
+
+// Glad needs to be included before GLFW.
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PROFILER_MAX_SCOPES 32
+// Statistics cover this many of the most recent samples of each scope.
+#define PROFILER_SAMPLE_COUNT 240
+// GPU timings are read this many frames late, so that reading them doesn't wait for the GPU.
+#define PROFILER_QUERY_COUNT 4
+
+struct ProfilerStats {
+    float min;
+    float mean;
+    float p99;
+    float max;
+};
+
+// A named span of work, timed on the CPU or the GPU in milliseconds. CPU scopes can be nested, a scope with the same
+// name under a different parent is tracked separately.
+struct ProfilerScope {
+    const char *name;
+    int32_t parent_i;
+    int32_t depth;
+    bool is_gpu;
+    double start_time;
+    double frame_time;
+    bool was_run;
+    float samples[PROFILER_SAMPLE_COUNT];
+    size_t sample_count;
+    size_t next_sample_i;
+    uint32_t queries[PROFILER_QUERY_COUNT];
+    bool is_query_pending[PROFILER_QUERY_COUNT];
+};
+
+// Profiles the main thread. Timer queries can't overlap, so GPU scopes can't be nested.
+struct Profiler {
+    struct ProfilerScope scopes[PROFILER_MAX_SCOPES];
+    size_t scope_count;
+    int32_t scope_stack[PROFILER_MAX_SCOPES];
+    size_t scope_stack_length;
+    int32_t gpu_scope_i;
+    size_t frame_i;
+};
+
+struct Profiler profiler_create(void);
+void profiler_begin_frame(struct Profiler *profiler);
+void profiler_end_frame(struct Profiler *profiler);
+void profiler_begin(struct Profiler *profiler, const char *name);
+void profiler_end(struct Profiler *profiler);
+void profiler_begin_gpu(struct Profiler *profiler, const char *name);
+void profiler_end_gpu(struct Profiler *profiler);
+struct ProfilerStats profiler_get_stats(struct ProfilerScope *scope);
+void profiler_print(struct Profiler *profiler);
+void profiler_destroy(struct Profiler *profiler);
+
+#endif
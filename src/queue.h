@@ -0,0 +1,82 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include "detect_leak.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <assert.h>
+#include <inttypes.h>
+
+// A fixed size, lock-free ring buffer that is safe to use with one producer thread and one consumer thread.
+// The capacity must be a power of two so that indices can wrap with a mask.
+#define QUEUE_DEFINE(type)                                                                                             \
+    struct Queue_##type {                                                                                              \
+        type *data;                                                                                                    \
+        size_t capacity;                                                                                               \
+        /* Only written by the consumer. */                                                                            \
+        _Atomic(size_t) head;                                                                                          \
+        /* Only written by the producer. */                                                                            \
+        _Atomic(size_t) tail;                                                                                          \
+    };                                                                                                                 \
+                                                                                                                       \
+    static inline struct Queue_##type queue_create_##type(size_t capacity) {                                           \
+        assert(capacity > 0 && (capacity & (capacity - 1)) == 0);                                                      \
+                                                                                                                       \
+        struct Queue_##type queue = (struct Queue_##type){                                                             \
+            .data = malloc(capacity * sizeof(type)),                                                                   \
+            .capacity = capacity,                                                                                      \
+            .head = 0,                                                                                                 \
+            .tail = 0,                                                                                                 \
+        };                                                                                                             \
+                                                                                                                       \
+        assert(queue.data);                                                                                            \
+                                                                                                                       \
+        return queue;                                                                                                  \
+    }                                                                                                                  \
+                                                                                                                       \
+    /* Returns false if the queue is full. Only call this from the producer thread. */                                 \
+    static inline bool queue_push_##type(struct Queue_##type *queue, type value) {                                     \
+        size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);                                        \
+        size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);                                        \
+                                                                                                                       \
+        if (tail - head == queue->capacity) {                                                                          \
+            return false;                                                                                              \
+        }                                                                                                              \
+                                                                                                                       \
+        queue->data[tail & (queue->capacity - 1)] = value;                                                             \
+        atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);                                           \
+                                                                                                                       \
+        return true;                                                                                                   \
+    }                                                                                                                  \
+                                                                                                                       \
+    /* Returns false if the queue is empty. Only call this from the consumer thread. */                                \
+    static inline bool queue_pop_##type(struct Queue_##type *queue, type *value) {                                     \
+        size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);                                        \
+        size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);                                        \
+                                                                                                                       \
+        if (head == tail) {                                                                                            \
+            return false;                                                                                              \
+        }                                                                                                              \
+                                                                                                                       \
+        *value = queue->data[head & (queue->capacity - 1)];                                                            \
+        atomic_store_explicit(&queue->head, head + 1, memory_order_release);                                           \
+                                                                                                                       \
+        return true;                                                                                                   \
+    }                                                                                                                  \
+                                                                                                                       \
+    /* Only call this from the consumer thread. */                                                                     \
+    static inline bool queue_is_empty_##type(struct Queue_##type *queue) {                                             \
+        return atomic_load_explicit(&queue->head, memory_order_relaxed) ==                                             \
+               atomic_load_explicit(&queue->tail, memory_order_acquire);                                               \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline void queue_destroy_##type(struct Queue_##type *queue) {                                              \
+        free(queue->data);                                                                                             \
+    }
+
+QUEUE_DEFINE(uint32_t)
+
+#endif
@@ -0,0 +1,526 @@
+#include "region.h"
+
+#include "codec.h"
+#include "file.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const char region_magic[4] = {'C', 'B', 'R', 'G'};
+
+#define REGION_HEADER_SECTOR_COUNT ((sizeof(struct RegionHeader) + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE)
+// Sector counts are stored in 8 bits.
+#define REGION_MAX_CHUNK_SECTOR_COUNT 255
+
+static size_t region_get_payload_capacity(void) {
+    return 2 * codec_rle_bound(chunk_length) + 2 * heightmap_length * sizeof(int32_t);
+}
+
+// Enough space for a record of any chunk, rounded up to whole sectors.
+size_t region_get_record_capacity(void) {
+    size_t record_length = sizeof(struct RegionChunkHeader) + codec_lz_bound(region_get_payload_capacity());
+    return (record_length + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE * REGION_SECTOR_SIZE;
+}
+
+// Chunk coordinates are in blocks, like the ones given to chunk_create.
+size_t region_get_chunk_index(int32_t x, int32_t z) {
+    size_t chunk_x = (size_t)(x / CHUNK_SIZE) % REGION_SIZE;
+    size_t chunk_z = (size_t)(z / CHUNK_SIZE) % REGION_SIZE;
+    return chunk_x + chunk_z * REGION_SIZE;
+}
+
+static void region_set_sectors(struct Region *region, size_t first_sector, size_t sector_count, bool is_used) {
+    for (size_t i = first_sector; i < first_sector + sector_count; i++) {
+        region->sector_usage.data[i] = is_used;
+    }
+}
+
+// Find the first run of free sectors long enough, growing the file if there isn't one.
+static size_t region_allocate_sectors(struct Region *region, size_t sector_count) {
+    size_t run_start = 0;
+    size_t run_length = 0;
+
+    for (size_t i = 0; i < region->sector_usage.length && run_length < sector_count; i++) {
+        if (region->sector_usage.data[i]) {
+            run_start = i + 1;
+            run_length = 0;
+        } else {
+            ++run_length;
+        }
+    }
+
+    while (region->sector_usage.length < run_start + sector_count) {
+        list_push_bool(&region->sector_usage, false);
+    }
+
+    region_set_sectors(region, run_start, sector_count, true);
+
+    return run_start;
+}
+
+// The size of an uncompressed record's payload, which is laid out like the chunk's own data.
+static size_t region_get_uncompressed_payload_length(void) {
+    return 2 * chunk_length + 2 * heightmap_length * sizeof(int32_t);
+}
+
+static bool region_is_header_valid(struct RegionHeader *header, int32_t x, int32_t z) {
+    return memcmp(header->magic, region_magic, sizeof(region_magic)) == 0 && header->version == REGION_VERSION &&
+           header->x == x && header->z == z;
+}
+
+static void region_unmap_file(struct Region *region) {
+#ifdef _WIN32
+    UnmapViewOfFile(region->mapping);
+    CloseHandle(region->mapping_handle);
+    CloseHandle(region->file_handle);
+#else
+    munmap((void *)region->mapping, region->mapping_length);
+#endif
+}
+
+// Map a whole region file read-only, returning false if it doesn't exist or is empty.
+static bool region_map_file(char *file_path, struct Region *region) {
+#ifdef _WIN32
+    HANDLE file_handle = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    HANDLE mapping_handle = NULL;
+    const uint8_t *mapping = NULL;
+
+    if (GetFileSizeEx(file_handle, &file_size) && file_size.QuadPart > 0) {
+        mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+
+    if (mapping_handle) {
+        mapping = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    }
+
+    if (!mapping) {
+        if (mapping_handle) {
+            CloseHandle(mapping_handle);
+        }
+
+        CloseHandle(file_handle);
+        return false;
+    }
+
+    region->file_handle = file_handle;
+    region->mapping_handle = mapping_handle;
+    region->mapping = mapping;
+    region->mapping_length = (size_t)file_size.QuadPart;
+#else
+    int file = open(file_path, O_RDONLY);
+    if (file == -1) {
+        return false;
+    }
+
+    struct stat file_stat;
+    const uint8_t *mapping = MAP_FAILED;
+
+    if (fstat(file, &file_stat) == 0 && file_stat.st_size > 0) {
+        mapping = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    }
+
+    // The mapping keeps the file alive.
+    close(file);
+
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    // Chunks are read in whatever order the world streams them, so reading ahead of a fault mostly reads the wrong
+    // chunks. region_prefetch_chunk asks for the ones the world expects to need instead.
+    madvise((void *)mapping, file_stat.st_size, MADV_RANDOM);
+
+    region->mapping = mapping;
+    region->mapping_length = file_stat.st_size;
+#endif
+
+    return true;
+}
+
+bool region_open(char *file_path, int32_t x, int32_t z, enum RegionMode mode, struct Region *region) {
+    struct RegionHeader header = {0};
+    size_t file_length = 0;
+    FILE *file = NULL;
+
+    *region = (struct Region){
+        .mode = mode,
+    };
+
+    if (mode == REGION_MODE_MAPPED) {
+        if (!region_map_file(file_path, region)) {
+            printf("Failed to map region file: %s\n", file_path);
+            return false;
+        }
+
+        if (region->mapping_length < sizeof(struct RegionHeader)) {
+            printf("Invalid region file: %s\n", file_path);
+            region_unmap_file(region);
+            return false;
+        }
+
+        memcpy(&header, region->mapping, sizeof(struct RegionHeader));
+        file_length = region->mapping_length;
+    } else if ((file = file_open(file_path, "r+b"))) {
+        if (fread(&header, sizeof(struct RegionHeader), 1, file) != 1) {
+            printf("Invalid region file: %s\n", file_path);
+            fclose(file);
+            return false;
+        }
+    } else {
+        file = file_open(file_path, "w+b");
+        if (!file) {
+            printf("Failed to create region file: %s\n", file_path);
+            return false;
+        }
+
+        memcpy(header.magic, region_magic, sizeof(region_magic));
+        header.version = REGION_VERSION;
+        header.x = x;
+        header.z = z;
+
+        // Pad the header out to whole sectors.
+        uint8_t padding[REGION_SECTOR_SIZE] = {0};
+        size_t padding_length = REGION_HEADER_SECTOR_COUNT * REGION_SECTOR_SIZE - sizeof(struct RegionHeader);
+
+        if (fwrite(&header, sizeof(struct RegionHeader), 1, file) != 1 ||
+            fwrite(padding, 1, padding_length, file) != padding_length) {
+            printf("Failed to write region file: %s\n", file_path);
+            fclose(file);
+            return false;
+        }
+    }
+
+    if (!region_is_header_valid(&header, x, z)) {
+        printf("Invalid region file: %s\n", file_path);
+
+        if (file) {
+            fclose(file);
+        } else {
+            region_unmap_file(region);
+        }
+
+        return false;
+    }
+
+    if (file) {
+        // Everything after this uses positional reads and writes, which bypass the stdio buffer.
+        fflush(file);
+
+        fseek(file, 0, SEEK_END);
+        file_length = (size_t)ftell(file);
+    }
+
+    // A mapping only covers whole sectors that are in the file, so a partial last sector can't hold a record.
+    size_t file_sector_count = mode == REGION_MODE_MAPPED ? file_length / REGION_SECTOR_SIZE
+                                                          : (file_length + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE;
+
+    region->file = file;
+    region->header = header;
+    region->sector_usage = list_create_bool(file_sector_count + 64);
+    region->payload = malloc(region_get_payload_capacity());
+    region->record = malloc(region_get_record_capacity());
+
+    assert(region->payload);
+    assert(region->record);
+
+    region->sector_usage.length = file_sector_count;
+    region_set_sectors(region, 0, file_sector_count, false);
+    region_set_sectors(region, 0, REGION_HEADER_SECTOR_COUNT, true);
+
+    // Forget chunks whose records point outside of the file or into the header, they'll be generated again.
+    for (size_t i = 0; i < REGION_CHUNK_COUNT; i++) {
+        size_t first_sector = REGION_FIRST_SECTOR(region->header.chunk_sectors[i]);
+        size_t sector_count = REGION_SECTOR_COUNT(region->header.chunk_sectors[i]);
+
+        if (sector_count == 0 || first_sector < REGION_HEADER_SECTOR_COUNT ||
+            first_sector + sector_count > file_sector_count) {
+            region->header.chunk_sectors[i] = 0;
+            continue;
+        }
+
+        region_set_sectors(region, first_sector, sector_count, true);
+    }
+
+    return true;
+}
+
+// Encode a chunk into a record padded to whole sectors, returning its sector count. The record must have space for
+// region_get_record_capacity bytes.
+size_t region_encode_chunk(struct Region *region, struct Chunk *chunk, uint8_t *record) {
+    assert(region->mode != REGION_MODE_MAPPED);
+
+    size_t heightmap_size = heightmap_length * sizeof(int32_t);
+    uint8_t *payload = region->mode == REGION_MODE_UNCOMPRESSED ? record + sizeof(struct RegionChunkHeader)
+                                                                : region->payload;
+    size_t payload_length = 0;
+
+    if (region->mode == REGION_MODE_UNCOMPRESSED) {
+        memcpy(payload, chunk->blocks, chunk_length);
+        memcpy(payload + chunk_length, chunk->lightmap, chunk_length);
+        payload_length = 2 * chunk_length;
+    } else {
+        // Blocks are stored with y changing fastest, so each column of chunk_height bytes is a run of y values.
+        payload_length += codec_rle_encode(chunk->blocks, chunk_length, chunk_height, payload + payload_length);
+        payload_length += codec_rle_encode(chunk->lightmap, chunk_length, chunk_height, payload + payload_length);
+    }
+
+    memcpy(payload + payload_length, chunk->heightmap_min, heightmap_size);
+    payload_length += heightmap_size;
+    memcpy(payload + payload_length, chunk->heightmap_max, heightmap_size);
+    payload_length += heightmap_size;
+
+    struct RegionChunkHeader chunk_header = (struct RegionChunkHeader){
+        .flags = 0,
+        .x = chunk->x,
+        .z = chunk->z,
+        .compressed_length = (uint32_t)payload_length,
+        .payload_length = (uint32_t)payload_length,
+        .generation = chunk->generation,
+        .is_lightmap_valid = chunk->is_lightmap_valid,
+    };
+    memcpy(chunk_header.light_neighbor_generations, chunk->light_neighbor_generations,
+        sizeof(chunk_header.light_neighbor_generations));
+
+    if (region->mode == REGION_MODE_UNCOMPRESSED) {
+        chunk_header.flags |= REGION_CHUNK_UNCOMPRESSED;
+    } else {
+        chunk_header.compressed_length =
+            (uint32_t)codec_lz_compress(payload, payload_length, record + sizeof(struct RegionChunkHeader));
+    }
+
+    memcpy(record, &chunk_header, sizeof(struct RegionChunkHeader));
+
+    size_t record_length = sizeof(struct RegionChunkHeader) + chunk_header.compressed_length;
+    size_t sector_count = (record_length + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE;
+    assert(sector_count <= REGION_MAX_CHUNK_SECTOR_COUNT);
+
+    // Zero the rest of the last sector so the file never contains leftover scratch data.
+    memset(record + record_length, 0, sector_count * REGION_SECTOR_SIZE - record_length);
+
+    return sector_count;
+}
+
+// Create a chunk from a record, returning false without creating it if the record is invalid or belongs to another
+// chunk. If the region is mapped and the record is uncompressed, the chunk uses the record's data where it is, so the
+// record must be in the mapping.
+bool region_decode_chunk(
+    struct Region *region, const uint8_t *record, size_t record_length, int32_t x, int32_t z, struct Chunk *chunk) {
+    if (record_length < sizeof(struct RegionChunkHeader)) {
+        return false;
+    }
+
+    struct RegionChunkHeader chunk_header;
+    memcpy(&chunk_header, record, sizeof(struct RegionChunkHeader));
+
+    size_t heightmap_size = heightmap_length * sizeof(int32_t);
+    size_t payload_length = chunk_header.payload_length;
+
+    if (chunk_header.x != x || chunk_header.z != z ||
+        chunk_header.compressed_length > record_length - sizeof(struct RegionChunkHeader)) {
+        return false;
+    }
+
+    if (chunk_header.flags & REGION_CHUNK_UNCOMPRESSED) {
+        if (payload_length != region_get_uncompressed_payload_length() ||
+            chunk_header.compressed_length != payload_length) {
+            return false;
+        }
+
+        // Records start on a sector boundary and the header is a multiple of 4 bytes, so the heightmaps are aligned.
+        uint8_t *payload = (uint8_t *)record + sizeof(struct RegionChunkHeader);
+        uint8_t *heightmaps = payload + 2 * chunk_length;
+
+        if (region->mapping) {
+            *chunk = chunk_create_mapped(x, z, payload, payload + chunk_length, (int32_t *)heightmaps,
+                (int32_t *)(heightmaps + heightmap_size));
+        } else {
+            *chunk = chunk_create_empty(x, z);
+            memcpy(chunk->blocks, payload, chunk_length);
+            memcpy(chunk->lightmap, payload + chunk_length, chunk_length);
+            memcpy(chunk->heightmap_min, heightmaps, heightmap_size);
+            memcpy(chunk->heightmap_max, heightmaps + heightmap_size, heightmap_size);
+        }
+    } else {
+        const uint8_t *payload = region->payload;
+
+        if (payload_length > region_get_payload_capacity() ||
+            !codec_lz_decompress(record + sizeof(struct RegionChunkHeader), chunk_header.compressed_length,
+                region->payload, payload_length)) {
+            return false;
+        }
+
+        *chunk = chunk_create_empty(x, z);
+
+        size_t length = codec_rle_decode(payload, payload_length, chunk->blocks, chunk_length);
+        size_t lightmap_length = 0;
+
+        if (length > 0) {
+            lightmap_length =
+                codec_rle_decode(payload + length, payload_length - length, chunk->lightmap, chunk_length);
+            length += lightmap_length;
+        }
+
+        if (lightmap_length == 0 || payload_length - length != 2 * heightmap_size) {
+            chunk_destroy(chunk);
+            return false;
+        }
+
+        memcpy(chunk->heightmap_min, payload + length, heightmap_size);
+        memcpy(chunk->heightmap_max, payload + length + heightmap_size, heightmap_size);
+    }
+
+    chunk->is_dirty = true;
+    chunk->generation = chunk_header.generation;
+    chunk->saved_generation = chunk_header.generation;
+    chunk->is_lightmap_valid = chunk_header.is_lightmap_valid != 0;
+    memcpy(chunk->light_neighbor_generations, chunk_header.light_neighbor_generations,
+        sizeof(chunk->light_neighbor_generations));
+
+    return true;
+}
+
+// Choose where a chunk's new record of sector_count sectors goes, returning its first sector. The record stays in
+// place if it still fits, otherwise it moves to the first free run of sectors. Only the region's copy of the chunk's
+// table entry is changed, region_write_chunk_sectors writes it to the file. The old sectors stay reserved until they're
+// given to region_release_sectors, so no other record can be written over them while the file still points at them.
+size_t region_place_chunk(struct Region *region, int32_t x, int32_t z, size_t sector_count) {
+    assert(region->mode != REGION_MODE_MAPPED);
+
+    size_t chunk_i = region_get_chunk_index(x, z);
+    size_t first_sector = REGION_FIRST_SECTOR(region->header.chunk_sectors[chunk_i]);
+    size_t old_sector_count = REGION_SECTOR_COUNT(region->header.chunk_sectors[chunk_i]);
+
+    if (old_sector_count < sector_count) {
+        first_sector = region_allocate_sectors(region, sector_count);
+    }
+
+    region->header.chunk_sectors[chunk_i] = (uint32_t)(first_sector << 8 | sector_count);
+
+    return first_sector;
+}
+
+// Write a range of the chunk table to the file in one go.
+bool region_write_chunk_sectors(struct Region *region, size_t first_chunk_i, size_t chunk_count) {
+    assert(region->mode != REGION_MODE_MAPPED);
+    assert(first_chunk_i + chunk_count <= REGION_CHUNK_COUNT);
+
+    return file_write_at(region->file, offsetof(struct RegionHeader, chunk_sectors) + first_chunk_i * sizeof(uint32_t),
+        region->header.chunk_sectors + first_chunk_i, chunk_count * sizeof(uint32_t));
+}
+
+// Free the sectors of a chunk's old table entry that its new entry doesn't use. Only call this once the new entry has
+// been written to the file.
+void region_release_sectors(struct Region *region, uint32_t old_chunk_sectors, uint32_t chunk_sectors) {
+    size_t first_sector = REGION_FIRST_SECTOR(chunk_sectors);
+    size_t last_sector = first_sector + REGION_SECTOR_COUNT(chunk_sectors);
+    size_t old_first_sector = REGION_FIRST_SECTOR(old_chunk_sectors);
+    size_t old_last_sector = old_first_sector + REGION_SECTOR_COUNT(old_chunk_sectors);
+
+    for (size_t i = old_first_sector; i < old_last_sector; i++) {
+        if (i < first_sector || i >= last_sector) {
+            region->sector_usage.data[i] = false;
+        }
+    }
+}
+
+// Load a single chunk, returning false without creating a chunk if it hasn't been saved or its record is invalid.
+bool region_load_chunk(struct Region *region, int32_t x, int32_t z, struct Chunk *chunk) {
+    uint32_t chunk_sectors = region->header.chunk_sectors[region_get_chunk_index(x, z)];
+    size_t record_length = REGION_SECTOR_COUNT(chunk_sectors) * REGION_SECTOR_SIZE;
+
+    if (record_length == 0) {
+        return false;
+    }
+
+    if (region->mapping) {
+        const uint8_t *record = region->mapping + REGION_FIRST_SECTOR(chunk_sectors) * REGION_SECTOR_SIZE;
+        return region_decode_chunk(region, record, record_length, x, z, chunk);
+    }
+
+    if (record_length > region_get_record_capacity() ||
+        !file_read_at(region->file, REGION_FIRST_SECTOR(chunk_sectors) * REGION_SECTOR_SIZE, region->record,
+            record_length)) {
+        return false;
+    }
+
+    return region_decode_chunk(region, region->record, record_length, x, z, chunk);
+}
+
+// Save a single chunk, only its own sectors and table entry are written.
+bool region_save_chunk(struct Region *region, struct Chunk *chunk) {
+    size_t chunk_i = region_get_chunk_index(chunk->x, chunk->z);
+    uint32_t old_chunk_sectors = region->header.chunk_sectors[chunk_i];
+    size_t sector_count = region_encode_chunk(region, chunk, region->record);
+    size_t first_sector = region_place_chunk(region, chunk->x, chunk->z, sector_count);
+
+    // If either write fails the file may still point at the old sectors, so they stay reserved.
+    if (!file_write_at(
+            region->file, first_sector * REGION_SECTOR_SIZE, region->record, sector_count * REGION_SECTOR_SIZE) ||
+        !region_write_chunk_sectors(region, chunk_i, 1)) {
+        return false;
+    }
+
+    region_release_sectors(region, old_chunk_sectors, region->header.chunk_sectors[chunk_i]);
+
+    return true;
+}
+
+// Ask for a mapped chunk's record to be read ahead of the chunk being loaded, so the load doesn't wait on page faults.
+void region_prefetch_chunk(struct Region *region, int32_t x, int32_t z) {
+    if (!region->mapping) {
+        return;
+    }
+
+    // A mapped region's chunk table never changes, so this is safe while another thread loads from the region.
+    uint32_t chunk_sectors = region->header.chunk_sectors[region_get_chunk_index(x, z)];
+
+    if (chunk_sectors == 0) {
+        return;
+    }
+
+    void *address = (void *)(region->mapping + REGION_FIRST_SECTOR(chunk_sectors) * REGION_SECTOR_SIZE);
+    size_t length = REGION_SECTOR_COUNT(chunk_sectors) * REGION_SECTOR_SIZE;
+
+#ifdef _WIN32
+    // Only available since Windows 8.
+#if _WIN32_WINNT >= 0x0602
+    WIN32_MEMORY_RANGE_ENTRY range = {.VirtualAddress = address, .NumberOfBytes = length};
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    (void)address;
+    (void)length;
+#endif
+#else
+    madvise(address, length, MADV_WILLNEED);
+#endif
+}
+
+void region_close(struct Region *region) {
+    if (region->mapping) {
+        region_unmap_file(region);
+    } else {
+        fclose(region->file);
+    }
+
+    list_destroy_bool(&region->sector_usage);
+    free(region->payload);
+    free(region->record);
+}
@@ -0,0 +1,101 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include "detect_leak.h"
+
+#include "chunk.h"
+#include "list.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define REGION_VERSION 4
+// Regions are REGION_SIZE x REGION_SIZE chunks.
+#define REGION_SIZE 32
+#define REGION_CHUNK_COUNT (REGION_SIZE * REGION_SIZE)
+#define REGION_SECTOR_SIZE 4096
+
+// A region file is this header followed by chunk records that each start on a sector boundary. Saving a chunk rewrites
+// its record in place when it still fits in its sectors and moves it to the first free run of sectors otherwise, so
+// loads and saves only touch the sectors of that chunk and its table entry. Sectors a record moved out of are only
+// reused once the table no longer points at them.
+struct RegionHeader {
+    char magic[4];
+    uint32_t version;
+    // Region coordinates, in regions.
+    int32_t x;
+    int32_t z;
+    // The first sector of each chunk's record in the upper 24 bits and its sector count in the lower 8 bits, or 0 if
+    // the chunk hasn't been saved.
+    uint32_t chunk_sectors[REGION_CHUNK_COUNT];
+};
+
+// Set on chunk records stored uncompressed.
+#define REGION_CHUNK_UNCOMPRESSED 0x1
+
+// A chunk record is this header followed by the LZ compressed payload. The payload is the run length encoded blocks
+// and lightmap followed by the min and max heightmaps. Uncompressed records store the blocks, lightmap and heightmaps
+// as they are in a chunk instead, so that they can be used straight from a mapping of the file.
+struct RegionChunkHeader {
+    uint32_t flags;
+    // The chunk's coordinates in blocks, a record is rejected if they aren't the ones it was loaded for.
+    int32_t x;
+    int32_t z;
+    uint32_t compressed_length;
+    uint32_t payload_length;
+    uint32_t generation;
+    // The chunk's is_lightmap_valid and light_neighbor_generations.
+    uint32_t is_lightmap_valid;
+    uint32_t light_neighbor_generations[CHUNK_NEIGHBOR_COUNT];
+};
+
+LIST_DEFINE(bool)
+
+enum RegionMode {
+    // Chunks are compressed when saved.
+    REGION_MODE_COMPRESSED,
+    // Chunks are saved uncompressed, making the file larger but letting a mapped region use them without copying.
+    REGION_MODE_UNCOMPRESSED,
+    // The file is mapped read-only and nothing can be saved. Uncompressed chunks are used straight from the mapping, so
+    // they're only read from disk once touched and share the page cache with every other process mapping the file.
+    REGION_MODE_MAPPED,
+};
+
+struct Region {
+    enum RegionMode mode;
+    // Only used if the region isn't mapped.
+    FILE *file;
+    // Only used if the region is mapped.
+    const uint8_t *mapping;
+    size_t mapping_length;
+#ifdef _WIN32
+    void *file_handle;
+    void *mapping_handle;
+#endif
+    struct RegionHeader header;
+    // Whether each sector of the file is used by the header or a chunk.
+    struct List_bool sector_usage;
+    // Scratch space for encoding and decoding chunks, a region should only be used by one thread at a time.
+    uint8_t *payload;
+    uint8_t *record;
+};
+
+#define REGION_FIRST_SECTOR(chunk_sectors) ((chunk_sectors) >> 8)
+#define REGION_SECTOR_COUNT(chunk_sectors) ((chunk_sectors)&0xff)
+
+bool region_open(char *file_path, int32_t x, int32_t z, enum RegionMode mode, struct Region *region);
+size_t region_get_chunk_index(int32_t x, int32_t z);
+size_t region_get_record_capacity(void);
+size_t region_encode_chunk(struct Region *region, struct Chunk *chunk, uint8_t *record);
+bool region_decode_chunk(
+    struct Region *region, const uint8_t *record, size_t record_length, int32_t x, int32_t z, struct Chunk *chunk);
+size_t region_place_chunk(struct Region *region, int32_t x, int32_t z, size_t sector_count);
+bool region_write_chunk_sectors(struct Region *region, size_t first_chunk_i, size_t chunk_count);
+void region_release_sectors(struct Region *region, uint32_t old_chunk_sectors, uint32_t chunk_sectors);
+void region_prefetch_chunk(struct Region *region, int32_t x, int32_t z);
+bool region_load_chunk(struct Region *region, int32_t x, int32_t z, struct Chunk *chunk);
+bool region_save_chunk(struct Region *region, struct Chunk *chunk);
+void region_close(struct Region *region);
+
+#endif
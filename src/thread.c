@@ -0,0 +1,216 @@
+#include "thread.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+struct Mutex {
+#ifdef _WIN32
+    SRWLOCK lock;
+#else
+    pthread_mutex_t lock;
+#endif
+};
+
+struct Condition {
+#ifdef _WIN32
+    CONDITION_VARIABLE variable;
+#else
+    pthread_cond_t variable;
+#endif
+};
+
+struct Thread {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t thread;
+#endif
+    ThreadFunction function;
+    void *argument;
+};
+
+struct Mutex *mutex_create(void) {
+    struct Mutex *mutex = malloc(sizeof(struct Mutex));
+    assert(mutex);
+
+#ifdef _WIN32
+    InitializeSRWLock(&mutex->lock);
+#else
+    int result = pthread_mutex_init(&mutex->lock, NULL);
+    assert(result == 0);
+    (void)result;
+#endif
+
+    return mutex;
+}
+
+void mutex_lock(struct Mutex *mutex) {
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&mutex->lock);
+#else
+    pthread_mutex_lock(&mutex->lock);
+#endif
+}
+
+// Returns true if the mutex was locked without waiting.
+bool mutex_try_lock(struct Mutex *mutex) {
+#ifdef _WIN32
+    return TryAcquireSRWLockExclusive(&mutex->lock);
+#else
+    return pthread_mutex_trylock(&mutex->lock) == 0;
+#endif
+}
+
+void mutex_unlock(struct Mutex *mutex) {
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(&mutex->lock);
+#else
+    pthread_mutex_unlock(&mutex->lock);
+#endif
+}
+
+void mutex_destroy(struct Mutex *mutex) {
+#ifndef _WIN32
+    pthread_mutex_destroy(&mutex->lock);
+#endif
+
+    free(mutex);
+}
+
+struct Condition *condition_create(void) {
+    struct Condition *condition = malloc(sizeof(struct Condition));
+    assert(condition);
+
+#ifdef _WIN32
+    InitializeConditionVariable(&condition->variable);
+#else
+    // Timed waits use the monotonic clock so that changes to the system time don't affect them.
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    int result = pthread_cond_init(&condition->variable, &attributes);
+    pthread_condattr_destroy(&attributes);
+    assert(result == 0);
+    (void)result;
+#endif
+
+    return condition;
+}
+
+// Wait until the condition is signalled, the mutex must be locked and is locked again when this returns. Like any
+// condition variable this can wake spuriously, so callers should wait in a loop that checks what they're waiting for.
+void condition_wait(struct Condition *condition, struct Mutex *mutex) {
+#ifdef _WIN32
+    SleepConditionVariableSRW(&condition->variable, &mutex->lock, INFINITE, 0);
+#else
+    pthread_cond_wait(&condition->variable, &mutex->lock);
+#endif
+}
+
+// Returns false if the wait timed out before the condition was signalled.
+bool condition_wait_timeout(struct Condition *condition, struct Mutex *mutex, uint32_t timeout_milliseconds) {
+#ifdef _WIN32
+    return SleepConditionVariableSRW(&condition->variable, &mutex->lock, timeout_milliseconds, 0);
+#else
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_milliseconds / 1000;
+    deadline.tv_nsec += (long)(timeout_milliseconds % 1000) * 1000000;
+
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    return pthread_cond_timedwait(&condition->variable, &mutex->lock, &deadline) != ETIMEDOUT;
+#endif
+}
+
+void condition_signal(struct Condition *condition) {
+#ifdef _WIN32
+    WakeConditionVariable(&condition->variable);
+#else
+    pthread_cond_signal(&condition->variable);
+#endif
+}
+
+void condition_broadcast(struct Condition *condition) {
+#ifdef _WIN32
+    WakeAllConditionVariable(&condition->variable);
+#else
+    pthread_cond_broadcast(&condition->variable);
+#endif
+}
+
+void condition_destroy(struct Condition *condition) {
+#ifndef _WIN32
+    pthread_cond_destroy(&condition->variable);
+#endif
+
+    free(condition);
+}
+
+#ifdef _WIN32
+DWORD WINAPI thread_start(void *start_thread) {
+    struct Thread *thread = start_thread;
+    thread->function(thread->argument);
+
+    return 0;
+}
+#else
+void *thread_start(void *start_thread) {
+    struct Thread *thread = start_thread;
+    thread->function(thread->argument);
+
+    return NULL;
+}
+#endif
+
+struct Thread *thread_create(ThreadFunction function, void *argument) {
+    struct Thread *thread = malloc(sizeof(struct Thread));
+    assert(thread);
+
+    thread->function = function;
+    thread->argument = argument;
+
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, thread_start, thread, 0, NULL);
+    assert(thread->handle);
+#else
+    int result = pthread_create(&thread->thread, NULL, thread_start, thread);
+    assert(result == 0);
+    (void)result;
+#endif
+
+    return thread;
+}
+
+// Wait for the thread to finish and free it.
+void thread_join(struct Thread *thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->thread, NULL);
+#endif
+
+    free(thread);
+}
+
+void thread_yield(void) {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
@@ -0,0 +1,37 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include "detect_leak.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+// Threads and synchronization implemented with Win32 on Windows and pthreads elsewhere. Both sides block in the kernel
+// (SRW locks and condition variables on Windows, futexes behind pthreads on Linux) rather than spinning. Atomics come
+// from C11's stdatomic.h.
+//
+// Mutexes, conditions and threads are handles, so they can be stored in structs that are copied.
+struct Mutex;
+struct Condition;
+struct Thread;
+
+typedef void (*ThreadFunction)(void *argument);
+
+struct Mutex *mutex_create(void);
+void mutex_lock(struct Mutex *mutex);
+bool mutex_try_lock(struct Mutex *mutex);
+void mutex_unlock(struct Mutex *mutex);
+void mutex_destroy(struct Mutex *mutex);
+
+struct Condition *condition_create(void);
+void condition_wait(struct Condition *condition, struct Mutex *mutex);
+bool condition_wait_timeout(struct Condition *condition, struct Mutex *mutex, uint32_t timeout_milliseconds);
+void condition_signal(struct Condition *condition);
+void condition_broadcast(struct Condition *condition);
+void condition_destroy(struct Condition *condition);
+
+struct Thread *thread_create(ThreadFunction function, void *argument);
+void thread_join(struct Thread *thread);
+void thread_yield(void);
+
+#endif
@@ -0,0 +1,184 @@
+#include "trace.h"
+#include "file.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef _MSC_VER
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL _Thread_local
+#endif
+
+// Each thread only writes to its own buffer, so recording an event never takes a lock. The writer publishes each
+// event by storing the new length, which lets trace_write read a buffer while its thread keeps recording.
+struct TraceBuffer {
+    struct TraceEvent *events;
+    _Atomic(size_t) length;
+    _Atomic(size_t) dropped_count;
+    _Atomic(const char *) thread_name;
+    _Atomic(bool) is_ready;
+};
+
+struct TraceBuffer trace_buffers[TRACE_MAX_THREADS];
+_Atomic(size_t) trace_buffer_count = 0;
+TRACE_THREAD_LOCAL struct TraceBuffer *trace_thread_buffer = NULL;
+
+// Nanoseconds from an arbitrary starting point.
+uint64_t trace_get_timestamp(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency = {0};
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart * 1000000000 +
+                      counter.QuadPart % frequency.QuadPart * 1000000000 / frequency.QuadPart);
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+#endif
+}
+
+// Get this thread's buffer, claiming one the first time the thread records an event.
+struct TraceBuffer *trace_get_thread_buffer(void) {
+    if (trace_thread_buffer) {
+        return trace_thread_buffer;
+    }
+
+    size_t buffer_i = atomic_fetch_add(&trace_buffer_count, 1);
+    if (buffer_i >= TRACE_MAX_THREADS) {
+        return NULL;
+    }
+
+    struct TraceBuffer *buffer = &trace_buffers[buffer_i];
+    buffer->events = malloc(TRACE_BUFFER_CAPACITY * sizeof(struct TraceEvent));
+    assert(buffer->events);
+    atomic_store(&buffer->is_ready, true);
+
+    trace_thread_buffer = buffer;
+
+    return buffer;
+}
+
+void trace_add_event(const char *name, char phase, int64_t value) {
+    struct TraceBuffer *buffer = trace_get_thread_buffer();
+    if (!buffer) {
+        return;
+    }
+
+    // Only this thread changes the length, so a relaxed load is enough here.
+    size_t length = atomic_load_explicit(&buffer->length, memory_order_relaxed);
+    if (length >= TRACE_BUFFER_CAPACITY) {
+        atomic_fetch_add_explicit(&buffer->dropped_count, 1, memory_order_relaxed);
+        return;
+    }
+
+    buffer->events[length] = (struct TraceEvent){
+        .name = name,
+        .value = value,
+        .timestamp = trace_get_timestamp(),
+        .phase = phase,
+    };
+
+    atomic_store_explicit(&buffer->length, length + 1, memory_order_release);
+}
+
+void trace_set_thread_name(const char *name) {
+    struct TraceBuffer *buffer = trace_get_thread_buffer();
+    if (buffer) {
+        atomic_store(&buffer->thread_name, name);
+    }
+}
+
+// Write every event recorded so far as Chrome trace JSON, which can be opened in Perfetto or chrome://tracing.
+void trace_write(char *file_path) {
+    FILE *file = file_open(file_path, "wb");
+
+    if (!file) {
+        printf("Failed to open trace file: %s\n", file_path);
+        return;
+    }
+
+    size_t buffer_count = atomic_load(&trace_buffer_count);
+    if (buffer_count > TRACE_MAX_THREADS) {
+        buffer_count = TRACE_MAX_THREADS;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    bool is_first_event = true;
+    for (size_t buffer_i = 0; buffer_i < buffer_count; buffer_i++) {
+        struct TraceBuffer *buffer = &trace_buffers[buffer_i];
+        if (!atomic_load(&buffer->is_ready)) {
+            continue;
+        }
+
+        const char *thread_name = atomic_load(&buffer->thread_name);
+        if (thread_name) {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+                is_first_event ? "" : ",\n", buffer_i, thread_name);
+            is_first_event = false;
+        }
+
+        size_t length = atomic_load_explicit(&buffer->length, memory_order_acquire);
+        for (size_t event_i = 0; event_i < length; event_i++) {
+            struct TraceEvent *event = &buffer->events[event_i];
+            double timestamp = event->timestamp / 1000.0;
+
+            if (event->phase == 'C') {
+                fprintf(file,
+                    "%s{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":0,\"tid\":%zu,\"args\":{\"value\":%" PRId64
+                    "}}",
+                    is_first_event ? "" : ",\n", event->name, timestamp, buffer_i, event->value);
+            } else {
+                fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":0,\"tid\":%zu}",
+                    is_first_event ? "" : ",\n", event->name, event->phase, timestamp, buffer_i);
+            }
+
+            is_first_event = false;
+        }
+
+        size_t dropped_count = atomic_load(&buffer->dropped_count);
+        if (dropped_count > 0) {
+            printf("Trace buffer %zu was full, %zu events were dropped\n", buffer_i, dropped_count);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    printf("Wrote trace: %s\n", file_path);
+}
+
+// Free every buffer. Threads keep their buffer until they exit, so only call this once every other thread that recorded
+// an event has been joined, otherwise its next event is written to a freed buffer.
+void trace_destroy(void) {
+    size_t buffer_count = atomic_load(&trace_buffer_count);
+    if (buffer_count > TRACE_MAX_THREADS) {
+        buffer_count = TRACE_MAX_THREADS;
+    }
+
+    for (size_t i = 0; i < buffer_count; i++) {
+        free(trace_buffers[i].events);
+        trace_buffers[i] = (struct TraceBuffer){0};
+    }
+
+    atomic_store(&trace_buffer_count, 0);
+    trace_thread_buffer = NULL;
+}
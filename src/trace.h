@@ -0,0 +1,42 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "detect_leak.h"
+
+#include <inttypes.h>
+
+// Events are only recorded when built with CBLOCK_TRACE, otherwise the macros compile to nothing. Event names must be
+// string literals, they are stored by pointer and written to the trace without escaping.
+#ifdef CBLOCK_TRACE
+#define TRACE_BEGIN(name) trace_add_event(name, 'B', 0)
+#define TRACE_END(name) trace_add_event(name, 'E', 0)
+#define TRACE_COUNTER(name, value) trace_add_event(name, 'C', value)
+#define TRACE_THREAD_NAME(name) trace_set_thread_name(name)
+#define TRACE_WRITE(file_path) trace_write(file_path)
+#define TRACE_DESTROY() trace_destroy()
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_WRITE(file_path) ((void)0)
+#define TRACE_DESTROY() ((void)0)
+#endif
+
+#define TRACE_MAX_THREADS 16
+// Events past this many on one thread are dropped.
+#define TRACE_BUFFER_CAPACITY (1 << 18)
+
+struct TraceEvent {
+    const char *name;
+    int64_t value;
+    uint64_t timestamp;
+    char phase;
+};
+
+void trace_add_event(const char *name, char phase, int64_t value);
+void trace_set_thread_name(const char *name);
+void trace_write(char *file_path);
+void trace_destroy(void);
+
+#endif
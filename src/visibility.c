@@ -0,0 +1,208 @@
+#include "visibility.h"
+#include "directions.h"
+
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+
+#define SECTION_VOLUME (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+#define SECTION_BLOCK_INDEX(x, y, z) ((x) + (y)*CHUNK_SIZE + (z)*CHUNK_SIZE * CHUNK_SIZE)
+
+// Bits are assigned to pairs of sides in order: (0, 1), (0, 2) ... (0, 5), (1, 2) ... (4, 5).
+static size_t visibility_get_bit(size_t side_a, size_t side_b) {
+    if (side_a > side_b) {
+        size_t temp = side_a;
+        side_a = side_b;
+        side_b = temp;
+    }
+
+    return side_a * (11 - side_a) / 2 + side_b - side_a - 1;
+}
+
+// Get a bit for each side of the section that a block in the section is touching, sides match directions.
+static uint8_t visibility_get_touched_sides(int32_t x, int32_t y, int32_t z) {
+    uint8_t touched_sides = 0;
+
+    if (z == 0) {
+        touched_sides |= 1 << 0; // Forward
+    }
+
+    if (z == CHUNK_SIZE - 1) {
+        touched_sides |= 1 << 1; // Backward
+    }
+
+    if (x == CHUNK_SIZE - 1) {
+        touched_sides |= 1 << 2; // Right
+    }
+
+    if (x == 0) {
+        touched_sides |= 1 << 3; // Left
+    }
+
+    if (y == CHUNK_SIZE - 1) {
+        touched_sides |= 1 << 4; // Up
+    }
+
+    if (y == 0) {
+        touched_sides |= 1 << 5; // Down
+    }
+
+    return touched_sides;
+}
+
+// Flood fill each region of air in the section, every pair of sides touched by the same region can see each other.
+uint16_t visibility_compute_section(struct Chunk *chunk, int32_t section_y) {
+    bool is_visited[SECTION_VOLUME];
+    uint16_t stack[SECTION_VOLUME];
+    int32_t min_y = section_y * CHUNK_SIZE;
+    uint16_t visibility = 0;
+
+    // Solid blocks are treated as already visited so the flood fill never enters them.
+    for (int32_t z = 0; z < CHUNK_SIZE; z++) {
+        for (int32_t y = 0; y < CHUNK_SIZE; y++) {
+            for (int32_t x = 0; x < CHUNK_SIZE; x++) {
+                is_visited[SECTION_BLOCK_INDEX(x, y, z)] = chunk_get_block(chunk, x, min_y + y, z) != 0;
+            }
+        }
+    }
+
+    for (uint16_t start_i = 0; start_i < SECTION_VOLUME; start_i++) {
+        if (is_visited[start_i]) {
+            continue;
+        }
+
+        uint8_t touched_sides = 0;
+        size_t stack_length = 0;
+        stack[stack_length++] = start_i;
+        is_visited[start_i] = true;
+
+        while (stack_length > 0) {
+            uint16_t block_i = stack[--stack_length];
+            int32_t x = block_i % CHUNK_SIZE;
+            int32_t y = block_i / CHUNK_SIZE % CHUNK_SIZE;
+            int32_t z = block_i / (CHUNK_SIZE * CHUNK_SIZE);
+
+            touched_sides |= visibility_get_touched_sides(x, y, z);
+
+            for (size_t side_i = 0; side_i < 6; side_i++) {
+                int32_t neighbor_x = x + directions[side_i].x;
+                int32_t neighbor_y = y + directions[side_i].y;
+                int32_t neighbor_z = z + directions[side_i].z;
+
+                if (neighbor_x < 0 || neighbor_x >= CHUNK_SIZE || neighbor_y < 0 || neighbor_y >= CHUNK_SIZE ||
+                    neighbor_z < 0 || neighbor_z >= CHUNK_SIZE) {
+                    continue;
+                }
+
+                uint16_t neighbor_i = SECTION_BLOCK_INDEX(neighbor_x, neighbor_y, neighbor_z);
+                if (!is_visited[neighbor_i]) {
+                    is_visited[neighbor_i] = true;
+                    stack[stack_length++] = neighbor_i;
+                }
+            }
+        }
+
+        for (size_t side_a = 0; side_a < 6; side_a++) {
+            for (size_t side_b = side_a + 1; side_b < 6; side_b++) {
+                if ((touched_sides & (1 << side_a)) && (touched_sides & (1 << side_b))) {
+                    visibility |= 1 << visibility_get_bit(side_a, side_b);
+                }
+            }
+        }
+
+        if (visibility == VISIBILITY_ALL) {
+            break;
+        }
+    }
+
+    return visibility;
+}
+
+bool visibility_is_connected(uint16_t visibility, size_t side_a, size_t side_b) {
+    if (side_a == side_b) {
+        return true;
+    }
+
+    return (visibility & (1 << visibility_get_bit(side_a, side_b))) != 0;
+}
+
+// Breadth first search outwards from the camera's section. A section is only entered if the section it's entered from
+// has air connecting the side the search came in through to the side it's leaving through.
+// Based on Tommaso Checchi's "Advanced Cave Culling Algorithm". The steps must have capacity for every section.
+void visibility_find_visible_sections(const uint16_t *section_visibility, const bool *is_section_in_frustum,
+    vec3s camera_position, struct List_struct_VisibilityStep *steps, bool *is_section_visible) {
+    const size_t section_total = world_length * CHUNK_SECTION_COUNT;
+
+    int32_t camera_x = (int32_t)floorf(camera_position.x / CHUNK_SIZE);
+    int32_t camera_y = (int32_t)floorf(camera_position.y / CHUNK_SIZE);
+    int32_t camera_z = (int32_t)floorf(camera_position.z / CHUNK_SIZE);
+
+    // There's no section to start searching from when the camera is outside of the world.
+    if (camera_x < 0 || camera_x >= world_size || camera_y < 0 || camera_y >= CHUNK_SECTION_COUNT || camera_z < 0 ||
+        camera_z >= world_size) {
+        memcpy(is_section_visible, is_section_in_frustum, section_total * sizeof(bool));
+        return;
+    }
+
+    memset(is_section_visible, 0, section_total * sizeof(bool));
+
+    // Every section is visited at most once, so the steps are written straight into a buffer sized for all of them
+    // rather than pushed. Pushing also makes gcc warn about writing past a zero sized realloc at -O2.
+    assert(steps->capacity >= section_total);
+    struct VisibilityStep *queue = steps->data;
+    size_t step_count = 0;
+
+    uint32_t camera_section_i = SECTION_INDEX(CHUNK_INDEX(camera_x, camera_z), camera_y);
+    is_section_visible[camera_section_i] = true;
+    queue[step_count++] = (struct VisibilityStep){
+        .section_i = camera_section_i,
+        .entered_side = -1,
+        .travelled_sides = 0,
+    };
+
+    // The buffer is used as a queue, steps are never removed so that the search is breadth first.
+    for (size_t step_i = 0; step_i < step_count; step_i++) {
+        struct VisibilityStep step = queue[step_i];
+        int32_t chunk_i = step.section_i / CHUNK_SECTION_COUNT;
+        int32_t section_x = chunk_i % world_size;
+        int32_t section_y = step.section_i % CHUNK_SECTION_COUNT;
+        int32_t section_z = chunk_i / world_size;
+
+        for (size_t side_i = 0; side_i < 6; side_i++) {
+            // Sides are stored in opposing pairs.
+            size_t opposite_side_i = side_i ^ 1;
+
+            if (step.travelled_sides & (1 << opposite_side_i)) {
+                continue;
+            }
+
+            if (step.entered_side != -1 &&
+                !visibility_is_connected(section_visibility[step.section_i], step.entered_side, side_i)) {
+                continue;
+            }
+
+            int32_t neighbor_x = section_x + directions[side_i].x;
+            int32_t neighbor_y = section_y + directions[side_i].y;
+            int32_t neighbor_z = section_z + directions[side_i].z;
+
+            if (neighbor_x < 0 || neighbor_x >= world_size || neighbor_y < 0 || neighbor_y >= CHUNK_SECTION_COUNT ||
+                neighbor_z < 0 || neighbor_z >= world_size) {
+                continue;
+            }
+
+            uint32_t neighbor_i = SECTION_INDEX(CHUNK_INDEX(neighbor_x, neighbor_z), neighbor_y);
+            if (is_section_visible[neighbor_i] || !is_section_in_frustum[neighbor_i]) {
+                continue;
+            }
+
+            is_section_visible[neighbor_i] = true;
+            queue[step_count++] = (struct VisibilityStep){
+                .section_i = neighbor_i,
+                .entered_side = opposite_side_i,
+                .travelled_sides = step.travelled_sides | (1 << side_i),
+            };
+        }
+    }
+
+    steps->length = step_count;
+}
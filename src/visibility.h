@@ -0,0 +1,36 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+#include "detect_leak.h"
+
+#include "chunk.h"
+#include "world.h"
+#include "list.h"
+
+#include <cglm/struct.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+// Each of the 15 pairs of a section's faces gets one bit, which is set if air connects those two faces.
+#define VISIBILITY_ALL 0x7fff
+
+#define SECTION_INDEX(chunk_i, section_y) ((section_y) + (chunk_i)*CHUNK_SECTION_COUNT)
+
+struct VisibilityStep {
+    uint32_t section_i;
+    // The side of this section that the search entered through, or -1 for the section containing the camera.
+    int8_t entered_side;
+    // A bit for each direction that has been travelled to get here, the search never travels back towards the camera.
+    uint8_t travelled_sides;
+};
+
+typedef struct VisibilityStep struct_VisibilityStep;
+LIST_DEFINE(struct_VisibilityStep)
+
+uint16_t visibility_compute_section(struct Chunk *chunk, int32_t section_y);
+bool visibility_is_connected(uint16_t visibility, size_t side_a, size_t side_b);
+void visibility_find_visible_sections(const uint16_t *section_visibility, const bool *is_section_in_frustum,
+    vec3s camera_position, struct List_struct_VisibilityStep *steps, bool *is_section_visible);
+
+#endif
@@ -1,7 +1,10 @@
 #include "world.h"
 #include "directions.h"
+#include "trace.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 #include <math.h>
 
@@ -10,24 +13,60 @@
 const size_t world_size = 4;
 const size_t world_length = world_size * world_size;
 const size_t world_size_in_blocks = world_size * CHUNK_SIZE;
-
-struct World world_create() {
+const float default_autosave_interval = 5.0f;
+const size_t default_autosave_chunk_count = 64;
+// How many chunks ahead of the camera world_prefetch_chunks reads.
+const int32_t prefetch_distance = 3;
+
+// Chunks saved in the region file are loaded with their lighting, the rest are generated. Passing a NULL region path
+// creates a world that is never saved, as does opening the region with REGION_MODE_MAPPED.
+struct World world_create(char *region_path, enum RegionMode region_mode) {
     struct World world = (struct World){
-        .chunks = malloc(world_length * sizeof(struct Chunk)),
+        .chunks = calloc(world_length, sizeof(struct Chunk)),
         .lighting_updates = list_create_struct_LightingUpdate(128),
-        .mutex = CreateMutex(NULL, FALSE, NULL),
+        .priority_lighting_updates = list_create_struct_LightingUpdate(128),
+        .mutex = mutex_create(),
+        .io = region_path ? chunk_io_create(region_path, region_mode) : NULL,
+        .autosave_interval = default_autosave_interval,
+        .autosave_chunk_count = default_autosave_chunk_count,
+        .autosave_timer = 0.0f,
+        .autosave_cursor = 0,
+        .prefetch_chunk_x = -1,
+        .prefetch_chunk_z = -1,
+        .backup_io = NULL,
+        .backup_path = NULL,
     };
 
     assert(world.chunks);
     assert(world.mutex);
 
+    // The whole world fits in the first region.
+    assert(world_size <= REGION_SIZE);
+
     for (size_t i = 0; i < world_length; i++) {
         int32_t chunk_x = (i % world_size) * CHUNK_SIZE;
         int32_t chunk_z = i / world_size * CHUNK_SIZE;
+
+        if (world.io) {
+            chunk_io_request_load(world.io, chunk_x, chunk_z);
+            continue;
+        }
+
         world.chunks[i] = chunk_create(chunk_x, chunk_z);
         world_init_chunk_lighting(&world, &world.chunks[i]);
     }
 
+    // Nothing can run until the world has all of its chunks, so wait for the first loads here.
+    if (world.io) {
+        chunk_io_submit(world.io);
+
+        size_t received_count = 0;
+        while (received_count < world_length) {
+            chunk_io_wait_for_completion(world.io);
+            received_count += world_receive_chunks(&world);
+        }
+    }
+
     return world;
 }
 
@@ -140,6 +179,8 @@ bool world_is_colliding_with_box(struct World *world, vec3s position, vec3s size
 
 // Request the minimum number of lighting updates necessary to ensure a new chunk is properly lit.
 void world_init_chunk_lighting(struct World *world, struct Chunk *chunk) {
+    chunk_make_writable(chunk);
+
     for (int32_t z = 0; z < CHUNK_SIZE; z++) {
         int32_t world_z = z + chunk->z;
         for (int32_t x = 0; x < CHUNK_SIZE; x++) {
@@ -169,9 +210,10 @@ void world_init_chunk_lighting(struct World *world, struct Chunk *chunk) {
 }
 
 // Based on xtreme8000's CavEX lighting algorithm.
-void world_update_lighting(struct World *world) {
-    while (world->lighting_updates.length > 0) {
-        struct LightingUpdate current = list_pop_struct_LightingUpdate(&world->lighting_updates);
+// Updates that spread from the processed list are pushed back onto the same list.
+static void world_process_lighting_updates(struct World *world, struct List_struct_LightingUpdate *lighting_updates) {
+    while (lighting_updates->length > 0) {
+        struct LightingUpdate current = list_pop_struct_LightingUpdate(lighting_updates);
 
         size_t chunk_i = CHUNK_INDEX(current.x / CHUNK_SIZE, current.z / CHUNK_SIZE);
         size_t heightmap_i = HEIGHTMAP_INDEX(current.x % CHUNK_SIZE, current.z % CHUNK_SIZE);
@@ -227,23 +269,42 @@ void world_update_lighting(struct World *world) {
                 if (neighbor_x >= 0 && neighbor_x < world_size_in_blocks && neighbor_y >= 0 &&
                     neighbor_y < chunk_height && neighbor_z >= 0 && neighbor_z < world_size_in_blocks) {
 
-                    list_push_struct_LightingUpdate(&world->lighting_updates, (struct LightingUpdate){
-                                                                                  .x = neighbor_x,
-                                                                                  .y = neighbor_y,
-                                                                                  .z = neighbor_z,
-                                                                              });
+                    list_push_struct_LightingUpdate(lighting_updates, (struct LightingUpdate){
+                                                                          .x = neighbor_x,
+                                                                          .y = neighbor_y,
+                                                                          .z = neighbor_z,
+                                                                      });
                 }
             }
         }
     }
 }
 
+void world_update_priority_lighting(struct World *world) {
+    TRACE_COUNTER("priority_lighting_updates", world->priority_lighting_updates.length);
+    TRACE_BEGIN("world_update_priority_lighting");
+    world_process_lighting_updates(world, &world->priority_lighting_updates);
+    TRACE_END("world_update_priority_lighting");
+}
+
+void world_update_lighting(struct World *world) {
+    TRACE_COUNTER("lighting_updates", world->lighting_updates.length);
+    TRACE_BEGIN("world_update_lighting");
+    world_process_lighting_updates(world, &world->priority_lighting_updates);
+    world_process_lighting_updates(world, &world->lighting_updates);
+    TRACE_END("world_update_lighting");
+}
+
 void world_set_block(struct World *world, int32_t x, int32_t y, int32_t z, uint8_t block) {
     if (x < 0 || x >= world_size_in_blocks || z < 0 || z >= world_size_in_blocks || y < 0 || y >= chunk_height) {
         return;
     }
 
-    WaitForSingleObject(world->mutex, INFINITE);
+    TRACE_BEGIN("world_set_block");
+
+    TRACE_BEGIN("world_mutex_wait");
+    mutex_lock(world->mutex);
+    TRACE_END("world_mutex_wait");
 
     int32_t chunk_x = x / CHUNK_SIZE;
     int32_t chunk_z = z / CHUNK_SIZE;
@@ -255,35 +316,374 @@ void world_set_block(struct World *world, int32_t x, int32_t y, int32_t z, uint8
     int32_t block_z = z % CHUNK_SIZE;
 
     chunk_set_block(&world->chunks[chunk_i], block_x, block_y, block_z, block);
-    list_push_struct_LightingUpdate(&world->lighting_updates, (struct LightingUpdate){x, y, z});
+    world->chunks[chunk_i].is_edited = true;
+    list_push_struct_LightingUpdate(&world->priority_lighting_updates, (struct LightingUpdate){x, y, z});
 
     if (block_x == 0 && chunk_x > 0) {
         world->chunks[CHUNK_INDEX(chunk_x - 1, chunk_z)].is_dirty = true;
+        world->chunks[CHUNK_INDEX(chunk_x - 1, chunk_z)].is_edited = true;
     }
 
     if (block_x == CHUNK_SIZE - 1 && chunk_x < world_size - 1) {
         world->chunks[CHUNK_INDEX(chunk_x + 1, chunk_z)].is_dirty = true;
+        world->chunks[CHUNK_INDEX(chunk_x + 1, chunk_z)].is_edited = true;
     }
 
     if (block_z == 0 && chunk_z > 0) {
         world->chunks[CHUNK_INDEX(chunk_x, chunk_z - 1)].is_dirty = true;
+        world->chunks[CHUNK_INDEX(chunk_x, chunk_z - 1)].is_edited = true;
     }
 
     if (block_z == CHUNK_SIZE - 1 && chunk_z < world_size - 1) {
         world->chunks[CHUNK_INDEX(chunk_x, chunk_z + 1)].is_dirty = true;
+        world->chunks[CHUNK_INDEX(chunk_x, chunk_z + 1)].is_edited = true;
+    }
+
+    mutex_unlock(world->mutex);
+
+    TRACE_END("world_set_block");
+}
+
+// Returns NULL for neighbors outside of the world.
+static struct Chunk *world_get_chunk_neighbor(
+    struct World *world, int32_t chunk_x, int32_t chunk_z, enum ChunkNeighbor neighbor) {
+    static const int32_t offsets[CHUNK_NEIGHBOR_COUNT][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+
+    int32_t neighbor_x = chunk_x + offsets[neighbor][0];
+    int32_t neighbor_z = chunk_z + offsets[neighbor][1];
+
+    if (neighbor_x < 0 || neighbor_x >= world_size || neighbor_z < 0 || neighbor_z >= world_size) {
+        return NULL;
+    }
+
+    return &world->chunks[CHUNK_INDEX(neighbor_x, neighbor_z)];
+}
+
+// Recalculate the light along the side of a chunk shared with a neighbor. Only the blocks on that side are updated,
+// changes spread inwards from there only as far as the light actually differs.
+static void world_relight_chunk_side(struct World *world, struct Chunk *chunk, enum ChunkNeighbor neighbor) {
+    for (int32_t i = 0; i < CHUNK_SIZE; i++) {
+        int32_t x = i;
+        int32_t z = i;
+
+        switch (neighbor) {
+        case CHUNK_NEIGHBOR_NEGATIVE_X:
+            x = 0;
+            break;
+        case CHUNK_NEIGHBOR_POSITIVE_X:
+            x = CHUNK_SIZE - 1;
+            break;
+        case CHUNK_NEIGHBOR_NEGATIVE_Z:
+            z = 0;
+            break;
+        default:
+            z = CHUNK_SIZE - 1;
+            break;
+        }
+
+        for (int32_t y = 0; y < chunk_height; y++) {
+            list_push_struct_LightingUpdate(
+                &world->lighting_updates, (struct LightingUpdate){chunk->x + x, y, chunk->z + z});
+        }
+    }
+}
+
+// Check the lightmaps of a chunk that was just put in the world and its neighbors against each other, recalculating the
+// light along the sides that are out of date.
+static void world_check_chunk_lighting(struct World *world, int32_t chunk_x, int32_t chunk_z) {
+    struct Chunk *chunk = &world->chunks[CHUNK_INDEX(chunk_x, chunk_z)];
+
+    for (enum ChunkNeighbor neighbor_i = 0; neighbor_i < CHUNK_NEIGHBOR_COUNT; neighbor_i++) {
+        struct Chunk *neighbor = world_get_chunk_neighbor(world, chunk_x, chunk_z, neighbor_i);
+
+        // Neighbors that haven't been loaded yet do this check once they are.
+        if (!neighbor || !neighbor->blocks) {
+            continue;
+        }
+
+        // Neighbors meshed against the old chunk need to be remeshed.
+        neighbor->is_dirty = true;
+
+        // A chunk lit from scratch only has its own light, so its side takes in the light of a saved lightmap next to
+        // it. A saved lightmap only needs its side relit if the chunk on the other side changed after it was saved.
+        bool is_chunk_side_stale = chunk->is_lightmap_valid
+                                       ? chunk->light_neighbor_generations[neighbor_i] != neighbor->generation
+                                       : neighbor->is_lightmap_valid;
+        if (is_chunk_side_stale) {
+            world_relight_chunk_side(world, chunk, neighbor_i);
+        }
+
+        // Neighbors are in pairs, so the opposite of a neighbor only differs in the lowest bit.
+        enum ChunkNeighbor opposite_i = neighbor_i ^ 1;
+
+        bool is_neighbor_side_stale = neighbor->is_lightmap_valid
+                                          ? neighbor->light_neighbor_generations[opposite_i] != chunk->generation
+                                          : chunk->is_lightmap_valid;
+        if (is_neighbor_side_stale) {
+            world_relight_chunk_side(world, neighbor, opposite_i);
+        }
+    }
+}
+
+// Put chunks loaded by the I/O thread into the world, generating the ones that weren't saved. Loaded chunks keep their
+// saved lighting unless it was saved before the light had settled. Chunks that failed to save are marked as unsaved
+// again, so they're saved with the next autosave. The world mutex is only taken if the I/O thread finished something,
+// so this is cheap to call every frame. Returns the number of chunks received.
+size_t world_receive_chunks(struct World *world) {
+    struct ChunkIoCompletion completion;
+
+    // Backups aren't retried, only reported.
+    while (world->backup_io && chunk_io_pop_completion(world->backup_io, &completion)) {
+        printf("Failed to back up chunk (%d, %d)\n", completion.x / CHUNK_SIZE, completion.z / CHUNK_SIZE);
+    }
+
+    if (!world->io) {
+        return 0;
+    }
+
+    size_t received_count = 0;
+    bool is_locked = false;
+
+    while (chunk_io_pop_completion(world->io, &completion)) {
+        if (!is_locked) {
+            mutex_lock(world->mutex);
+            is_locked = true;
+        }
+
+        int32_t chunk_x = completion.x / CHUNK_SIZE;
+        int32_t chunk_z = completion.z / CHUNK_SIZE;
+        struct Chunk *chunk = &world->chunks[CHUNK_INDEX(chunk_x, chunk_z)];
+
+        // A later save of the chunk may already be queued, then that one is waited for instead.
+        if (completion.type == CHUNK_IO_SAVE) {
+            if (chunk->saved_generation == completion.generation) {
+                chunk->saved_generation = completion.saved_generation;
+            }
+
+            continue;
+        }
+
+        chunk_destroy(chunk);
+
+        if (completion.is_loaded) {
+            *chunk = completion.chunk;
+
+            if (!chunk->is_lightmap_valid) {
+                chunk_make_writable(chunk);
+                memset(chunk->lightmap, 0, chunk_length);
+                world_init_chunk_lighting(world, chunk);
+            }
+        } else {
+            *chunk = chunk_create(completion.x, completion.z);
+            world_init_chunk_lighting(world, chunk);
+        }
+
+        world_check_chunk_lighting(world, chunk_x, chunk_z);
+
+        ++received_count;
+    }
+
+    if (is_locked) {
+        mutex_unlock(world->mutex);
     }
 
-    ReleaseMutex(world->mutex);
+    return received_count;
+}
+
+// Stamp a snapshot of a chunk with what its lightmap was lit against, the caller must hold the world mutex. Light has
+// only settled once every pending update has been processed.
+static void world_stamp_chunk_lighting(struct World *world, struct Chunk *snapshot) {
+    snapshot->is_lightmap_valid =
+        world->lighting_updates.length == 0 && world->priority_lighting_updates.length == 0;
+
+    for (enum ChunkNeighbor neighbor_i = 0; neighbor_i < CHUNK_NEIGHBOR_COUNT; neighbor_i++) {
+        struct Chunk *neighbor =
+            world_get_chunk_neighbor(world, snapshot->x / CHUNK_SIZE, snapshot->z / CHUNK_SIZE, neighbor_i);
+        snapshot->light_neighbor_generations[neighbor_i] = neighbor ? neighbor->generation : 0;
+    }
 }
 
+// Queue saves of up to max_count chunks with block changes that haven't been saved, starting from the autosave cursor.
+// Chunks are snapshotted so the I/O thread can write them while the world keeps changing, the caller must hold the
+// world mutex.
+static size_t world_save_modified_chunks(struct World *world, size_t max_count) {
+    // A mapped region is read-only, edits are lost when the world is destroyed.
+    if (world->io->region.mode == REGION_MODE_MAPPED) {
+        return 0;
+    }
+
+    size_t saved_count = 0;
+
+    for (size_t i = 0; i < world_length && saved_count < max_count; i++) {
+        struct Chunk *chunk = &world->chunks[world->autosave_cursor];
+        world->autosave_cursor = (world->autosave_cursor + 1) % world_length;
+
+        if (chunk->generation == chunk->saved_generation) {
+            continue;
+        }
+
+        // The snapshot keeps the old saved_generation, so it can be restored if the save fails.
+        struct Chunk snapshot = chunk_snapshot(chunk);
+        world_stamp_chunk_lighting(world, &snapshot);
+
+        chunk->saved_generation = chunk->generation;
+
+        chunk_io_request_save(world->io, snapshot);
+        ++saved_count;
+    }
+
+    if (saved_count > 0) {
+        chunk_io_submit(world->io);
+    }
+
+    TRACE_COUNTER("saved_chunks", saved_count);
+
+    return saved_count;
+}
+
+// Call once per frame with how far the camera moved. When the camera enters a new chunk, the chunks ahead of it in the
+// direction it's moving are read ahead, so they're in memory before the meshing thread or lighting touches them. Only
+// mapped regions are read lazily, for the others this does nothing.
+void world_prefetch_chunks(struct World *world, vec3s position, vec3s movement) {
+    if (!world->io || world->io->region.mode != REGION_MODE_MAPPED) {
+        return;
+    }
+
+    int32_t chunk_x = (int32_t)floorf(position.x / CHUNK_SIZE);
+    int32_t chunk_z = (int32_t)floorf(position.z / CHUNK_SIZE);
+    float speed = sqrtf(movement.x * movement.x + movement.z * movement.z);
+
+    if ((chunk_x == world->prefetch_chunk_x && chunk_z == world->prefetch_chunk_z) || speed == 0.0f) {
+        return;
+    }
+
+    world->prefetch_chunk_x = chunk_x;
+    world->prefetch_chunk_z = chunk_z;
+
+    float direction_x = movement.x / speed;
+    float direction_z = movement.z / speed;
+
+    // A band of chunks three wide, starting next to the camera's chunk.
+    for (int32_t distance = 1; distance <= prefetch_distance; distance++) {
+        for (int32_t offset = -1; offset <= 1; offset++) {
+            int32_t x = chunk_x + (int32_t)roundf(direction_x * distance - direction_z * offset);
+            int32_t z = chunk_z + (int32_t)roundf(direction_z * distance + direction_x * offset);
+
+            if (x >= 0 && x < world_size && z >= 0 && z < world_size) {
+                chunk_io_prefetch(world->io, x * CHUNK_SIZE, z * CHUNK_SIZE);
+            }
+        }
+    }
+}
+
+// Call once per frame. If the meshing thread holds the world the autosave is tried again next frame rather than
+// waiting for it.
+void world_autosave(struct World *world, float delta_time) {
+    if (!world->io) {
+        return;
+    }
+
+    world->autosave_timer += delta_time;
+
+    if (world->autosave_timer < world->autosave_interval || !mutex_try_lock(world->mutex)) {
+        return;
+    }
+
+    TRACE_BEGIN("world_autosave");
+
+    world_save_modified_chunks(world, world->autosave_chunk_count);
+    world->autosave_timer = 0.0f;
+
+    mutex_unlock(world->mutex);
+
+    TRACE_END("world_autosave");
+}
+
+// Queue saves of every chunk with block changes that haven't been saved.
+void world_save(struct World *world) {
+    if (!world->io) {
+        return;
+    }
+
+    TRACE_BEGIN("world_save");
+
+    mutex_lock(world->mutex);
+    world_save_modified_chunks(world, world_length);
+    mutex_unlock(world->mutex);
+
+    TRACE_END("world_save");
+}
+
+// Queue a copy of every chunk to be written to another region file, returning false if it couldn't be opened. The
+// chunks are snapshotted, so the world mutex is only held briefly and the world can keep changing while the backup's
+// own I/O thread writes them. The thread is kept for later backups to the same file.
+bool world_backup(struct World *world, char *region_path) {
+    if (world->backup_io && strcmp(world->backup_path, region_path) != 0) {
+        chunk_io_destroy(world->backup_io);
+        free(world->backup_path);
+        world->backup_io = NULL;
+    }
+
+    if (!world->backup_io) {
+        world->backup_io = chunk_io_create(region_path, REGION_MODE_COMPRESSED);
+        if (!world->backup_io) {
+            return false;
+        }
+
+        size_t path_length = strlen(region_path) + 1;
+        world->backup_path = malloc(path_length);
+        assert(world->backup_path);
+        memcpy(world->backup_path, region_path, path_length);
+    }
+
+    TRACE_BEGIN("world_backup");
+
+    mutex_lock(world->mutex);
+
+    // The I/O thread takes the snapshots and destroys each once it's written.
+    for (size_t i = 0; i < world_length; i++) {
+        struct Chunk snapshot = chunk_snapshot(&world->chunks[i]);
+        world_stamp_chunk_lighting(world, &snapshot);
+        chunk_io_request_save(world->backup_io, snapshot);
+    }
+
+    mutex_unlock(world->mutex);
+
+    chunk_io_submit(world->backup_io);
+
+    TRACE_END("world_backup");
+
+    return true;
+}
+
+// Saves the world, first finishing its lighting so the saved lightmaps are complete and don't need to be recalculated
+// when loaded. Waits for the saves to be written.
 void world_destroy(struct World *world) {
-    CloseHandle(world->mutex);
+    if (world->io) {
+        world_update_lighting(world);
+        world_save(world);
+    }
+
+    mutex_destroy(world->mutex);
 
+    // Saves are snapshots, so the chunks can go before the I/O threads are done with them. Chunks used straight from a
+    // mapped region can't outlive its mapping.
     for (size_t i = 0; i < world_length; i++) {
         chunk_destroy(&world->chunks[i]);
     }
 
+    // Backups of chunks used straight from a mapped region need the mapping until they're written.
+    if (world->backup_io) {
+        chunk_io_destroy(world->backup_io);
+        free(world->backup_path);
+    }
+
+    if (world->io) {
+        chunk_io_destroy(world->io);
+    }
+
     list_destroy_struct_LightingUpdate(&world->lighting_updates);
+    list_destroy_struct_LightingUpdate(&world->priority_lighting_updates);
 
     free(world->chunks);
 }
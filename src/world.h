@@ -5,14 +5,13 @@
 
 #include "chunk.h"
 #include "list.h"
+#include "chunk_io.h"
+#include "thread.h"
 
 #include <cglm/struct.h>
 
 #include <stdbool.h>
 
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
-
 extern const size_t world_size;
 extern const size_t world_length;
 extern const size_t world_size_in_blocks;
@@ -24,12 +23,28 @@ struct LightingUpdate {
 };
 
 typedef struct LightingUpdate struct_LightingUpdate;
-LIST_DEFINE(struct_LightingUpdate);
+LIST_DEFINE(struct_LightingUpdate)
 
 struct World {
     struct Chunk *chunks;
     struct List_struct_LightingUpdate lighting_updates;
-    HANDLE mutex;
+    // Lighting updates caused by player edits, these are processed before any other updates.
+    struct List_struct_LightingUpdate priority_lighting_updates;
+    struct Mutex *mutex;
+    // Loads and saves chunks in the world's region file, or NULL if the world isn't saved.
+    struct ChunkIo *io;
+    // Autosave queues at most autosave_chunk_count modified chunks every autosave_interval seconds, each time picking
+    // up from the cursor so that every chunk gets its turn.
+    float autosave_interval;
+    size_t autosave_chunk_count;
+    float autosave_timer;
+    size_t autosave_cursor;
+    // The chunk the camera was in when world_prefetch_chunks last read ahead.
+    int32_t prefetch_chunk_x;
+    int32_t prefetch_chunk_z;
+    // Writes backups to the file at backup_path, or NULL if the world hasn't been backed up.
+    struct ChunkIo *backup_io;
+    char *backup_path;
 };
 
 struct RaycastHit {
@@ -41,12 +56,18 @@ struct RaycastHit {
 
 #define CHUNK_INDEX(chunk_x, chunk_z) ((chunk_x) + (chunk_z)*world_size)
 
-struct World world_create();
+struct World world_create(char *region_path, enum RegionMode region_mode);
 struct RaycastHit world_raycast(struct World *world, vec3s start, vec3s direction, float range);
 bool world_is_colliding_with_box(struct World *world, vec3s position, vec3s size, vec3s origin);
 void world_init_chunk_lighting(struct World *world, struct Chunk *chunk);
+void world_update_priority_lighting(struct World *world);
 void world_update_lighting(struct World *world);
 void world_set_block(struct World *world, int32_t x, int32_t y, int32_t z, uint8_t block);
+size_t world_receive_chunks(struct World *world);
+void world_prefetch_chunks(struct World *world, vec3s position, vec3s movement);
+void world_autosave(struct World *world, float delta_time);
+void world_save(struct World *world);
+bool world_backup(struct World *world, char *region_path);
 void world_destroy(struct World *world);
 
 inline uint8_t world_get_block(struct World *world, int32_t x, int32_t y, int32_t z) {
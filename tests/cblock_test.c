@@ -0,0 +1,299 @@
+// Headless checks for the code that reads untrusted data from disk: the RLE and LZ codecs and region chunk records.
+// Every run uses the same seeds, so a failure can be reproduced. Usage: cblock_test
+
+#include "../src/chunk.h"
+#include "../src/codec.h"
+#include "../src/region.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_CHECK(condition) test_check(condition, #condition, __FILE__, __LINE__)
+
+const uint32_t test_seed = 0x9e3779b9;
+// Scratch file for the region tests, removed once they finish.
+char *test_region_path = "cblock_test_region.cbrg";
+
+size_t test_failure_count = 0;
+
+void test_check(bool condition, const char *expression, const char *file, int line) {
+    if (!condition) {
+        printf("%s:%d: check failed: %s\n", file, line, expression);
+        ++test_failure_count;
+    }
+}
+
+// Xorshift, so every run tests the same data.
+uint32_t test_random(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+// A chunk of random blocks and light, which compresses badly and gives the largest records.
+void test_fill_random_chunk(struct Chunk *chunk, uint32_t *random_state) {
+    for (size_t i = 0; i < chunk_length; i++) {
+        chunk->blocks[i] = (uint8_t)test_random(random_state);
+        chunk->lightmap[i] = (uint8_t)test_random(random_state);
+    }
+
+    for (size_t i = 0; i < heightmap_length; i++) {
+        chunk->heightmap_min[i] = 0;
+        chunk->heightmap_max[i] = (int32_t)(chunk_height - 1);
+    }
+}
+
+bool test_are_chunks_equal(struct Chunk *a, struct Chunk *b) {
+    size_t heightmap_size = heightmap_length * sizeof(int32_t);
+
+    return a->x == b->x && a->z == b->z && a->generation == b->generation &&
+           memcmp(a->blocks, b->blocks, chunk_length) == 0 && memcmp(a->lightmap, b->lightmap, chunk_length) == 0 &&
+           memcmp(a->heightmap_min, b->heightmap_min, heightmap_size) == 0 &&
+           memcmp(a->heightmap_max, b->heightmap_max, heightmap_size) == 0;
+}
+
+void test_rle_round_trip(const uint8_t *data, size_t length) {
+    uint8_t *encoded = malloc(codec_rle_bound(length));
+    uint8_t *decoded = malloc(length);
+
+    size_t encoded_length = codec_rle_encode(data, length, chunk_height, encoded);
+    TEST_CHECK(encoded_length <= codec_rle_bound(length));
+    TEST_CHECK(codec_rle_decode(encoded, encoded_length, decoded, length) == encoded_length);
+    TEST_CHECK(memcmp(data, decoded, length) == 0);
+
+    free(encoded);
+    free(decoded);
+}
+
+void test_lz_round_trip(const uint8_t *data, size_t length) {
+    uint8_t *compressed = malloc(codec_lz_bound(length));
+    uint8_t *decompressed = malloc(length);
+
+    size_t compressed_length = codec_lz_compress(data, length, compressed);
+    TEST_CHECK(compressed_length <= codec_lz_bound(length));
+    TEST_CHECK(codec_lz_decompress(compressed, compressed_length, decompressed, length));
+    TEST_CHECK(memcmp(data, decompressed, length) == 0);
+
+    // Every stream is exactly one length, anything else is rejected.
+    TEST_CHECK(!codec_lz_decompress(compressed, compressed_length, decompressed, length - 1));
+
+    free(compressed);
+    free(decompressed);
+}
+
+void test_codec_round_trips(void) {
+    uint32_t random_state = test_seed;
+    uint8_t *flat = calloc(chunk_length, 1);
+    uint8_t *random = malloc(chunk_length);
+
+    for (size_t i = 0; i < chunk_length; i++) {
+        random[i] = (uint8_t)test_random(&random_state);
+    }
+
+    test_rle_round_trip(flat, chunk_length);
+    test_rle_round_trip(random, chunk_length);
+    test_lz_round_trip(flat, chunk_length);
+    test_lz_round_trip(random, chunk_length);
+
+    free(flat);
+    free(random);
+}
+
+void test_rle_rejects_invalid(void) {
+    uint8_t data[64] = {0};
+    uint8_t decoded[64];
+    uint8_t encoded[128];
+
+    size_t encoded_length = codec_rle_encode(data, sizeof(data), sizeof(data), encoded);
+
+    // Truncated before the last run, and halfway through a run.
+    TEST_CHECK(codec_rle_decode(encoded, encoded_length - 2, decoded, sizeof(decoded)) == 0);
+    TEST_CHECK(codec_rle_decode(encoded, encoded_length - 1, decoded, sizeof(decoded)) == 0);
+
+    // A run longer than the space left.
+    uint8_t long_run[2] = {255, 1};
+    TEST_CHECK(codec_rle_decode(long_run, sizeof(long_run), decoded, sizeof(decoded)) == 0);
+}
+
+void test_lz_rejects_invalid(void) {
+    uint8_t decompressed[64];
+
+    // A match offset of zero, and one reaching back before the start of the output.
+    uint8_t zero_offset[] = {0x10, 'a', 0, 0, 0x00};
+    uint8_t far_offset[] = {0x10, 'a', 2, 0, 0x00};
+    TEST_CHECK(!codec_lz_decompress(zero_offset, sizeof(zero_offset), decompressed, 5));
+    TEST_CHECK(!codec_lz_decompress(far_offset, sizeof(far_offset), decompressed, 5));
+
+    // A match longer than the space left, given with an extra length byte.
+    uint8_t long_match[] = {0x1f, 'a', 1, 0, 200, 0x00};
+    TEST_CHECK(!codec_lz_decompress(long_match, sizeof(long_match), decompressed, sizeof(decompressed)));
+
+    // A stream that stops after a match, without the literal only sequence that ends every stream.
+    uint8_t missing_end[] = {0x10, 'a', 1, 0};
+    TEST_CHECK(!codec_lz_decompress(missing_end, sizeof(missing_end), decompressed, 5));
+
+    // More literals than the stream holds, and a length that runs off the end of the stream.
+    uint8_t missing_literals[] = {0x40, 'a', 'b'};
+    uint8_t unfinished_length[] = {0xf0, 255, 255};
+    TEST_CHECK(!codec_lz_decompress(missing_literals, sizeof(missing_literals), decompressed, 4));
+    TEST_CHECK(!codec_lz_decompress(unfinished_length, sizeof(unfinished_length), decompressed, sizeof(decompressed)));
+
+    // A real stream cut short at every length.
+    uint32_t random_state = test_seed;
+    uint8_t data[4096];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(test_random(&random_state) % 4);
+    }
+
+    uint8_t *compressed = malloc(codec_lz_bound(sizeof(data)));
+    uint8_t *output = malloc(sizeof(data));
+    size_t compressed_length = codec_lz_compress(data, sizeof(data), compressed);
+
+    for (size_t length = 0; length < compressed_length; length++) {
+        TEST_CHECK(!codec_lz_decompress(compressed, length, output, sizeof(data)));
+    }
+
+    // Corrupted streams may still decode to something, but never outside of the output.
+    for (size_t i = 0; i < 1000; i++) {
+        uint8_t *corrupted = malloc(compressed_length);
+        memcpy(corrupted, compressed, compressed_length);
+        corrupted[test_random(&random_state) % compressed_length] ^= (uint8_t)(1 + test_random(&random_state) % 255);
+
+        codec_lz_decompress(corrupted, compressed_length, output, sizeof(data));
+        free(corrupted);
+    }
+
+    free(compressed);
+    free(output);
+}
+
+// Save and load chunks in a fresh region file, including a chunk that grows out of its sectors and has to move.
+void test_region_round_trip(enum RegionMode mode) {
+    remove(test_region_path);
+
+    struct Region region;
+    TEST_CHECK(region_open(test_region_path, 0, 0, mode, &region));
+
+    uint32_t random_state = test_seed;
+    struct Chunk flat = chunk_create_empty(0, 0);
+    struct Chunk neighbor = chunk_create_empty(CHUNK_SIZE, 0);
+
+    TEST_CHECK(region_save_chunk(&region, &flat));
+    TEST_CHECK(region_save_chunk(&region, &neighbor));
+
+    uint32_t flat_sectors = region.header.chunk_sectors[region_get_chunk_index(0, 0)];
+
+    struct Chunk loaded;
+    TEST_CHECK(region_load_chunk(&region, 0, 0, &loaded));
+    TEST_CHECK(test_are_chunks_equal(&flat, &loaded));
+    chunk_destroy(&loaded);
+
+    // A chunk that was never saved isn't loaded.
+    TEST_CHECK(!region_load_chunk(&region, 2 * CHUNK_SIZE, 0, &loaded));
+
+    // Random data doesn't compress, so the record no longer fits in front of its neighbor's.
+    test_fill_random_chunk(&flat, &random_state);
+    flat.generation = 7;
+    TEST_CHECK(region_save_chunk(&region, &flat));
+
+    // Uncompressed records are all the same size, so they never move.
+    uint32_t moved_sectors = region.header.chunk_sectors[region_get_chunk_index(0, 0)];
+    if (mode == REGION_MODE_COMPRESSED) {
+        TEST_CHECK(REGION_FIRST_SECTOR(moved_sectors) != REGION_FIRST_SECTOR(flat_sectors));
+    }
+
+    region_close(&region);
+
+    // Reopening reads the chunk table back from the file.
+    TEST_CHECK(region_open(test_region_path, 0, 0, mode, &region));
+
+    TEST_CHECK(region_load_chunk(&region, 0, 0, &loaded));
+    TEST_CHECK(test_are_chunks_equal(&flat, &loaded));
+    chunk_destroy(&loaded);
+
+    TEST_CHECK(region_load_chunk(&region, CHUNK_SIZE, 0, &loaded));
+    TEST_CHECK(test_are_chunks_equal(&neighbor, &loaded));
+    chunk_destroy(&loaded);
+
+    // A table entry pointing at another chunk's record is rejected.
+    region.header.chunk_sectors[region_get_chunk_index(2 * CHUNK_SIZE, 0)] = moved_sectors;
+    TEST_CHECK(!region_load_chunk(&region, 2 * CHUNK_SIZE, 0, &loaded));
+
+    region_close(&region);
+
+    chunk_destroy(&flat);
+    chunk_destroy(&neighbor);
+    remove(test_region_path);
+}
+
+// Records with a corrupted header or payload are rejected rather than loaded.
+void test_region_rejects_invalid(void) {
+    remove(test_region_path);
+
+    struct Region region;
+    TEST_CHECK(region_open(test_region_path, 0, 0, REGION_MODE_COMPRESSED, &region));
+
+    uint32_t random_state = test_seed;
+    struct Chunk chunk = chunk_create_empty(0, 0);
+    test_fill_random_chunk(&chunk, &random_state);
+
+    uint8_t *record = malloc(region_get_record_capacity());
+    size_t record_length = region_encode_chunk(&region, &chunk, record) * REGION_SECTOR_SIZE;
+
+    struct RegionChunkHeader chunk_header;
+    memcpy(&chunk_header, record, sizeof(chunk_header));
+
+    struct Chunk loaded;
+    TEST_CHECK(region_decode_chunk(&region, record, record_length, 0, 0, &loaded));
+    chunk_destroy(&loaded);
+
+    // Loaded for the wrong chunk, and cut off in the middle of the header.
+    TEST_CHECK(!region_decode_chunk(&region, record, record_length, CHUNK_SIZE, 0, &loaded));
+    TEST_CHECK(!region_decode_chunk(&region, record, sizeof(chunk_header) - 1, 0, 0, &loaded));
+
+    // The compressed payload is longer than the record.
+    struct RegionChunkHeader corrupted_header = chunk_header;
+    corrupted_header.compressed_length = (uint32_t)record_length;
+    memcpy(record, &corrupted_header, sizeof(corrupted_header));
+    TEST_CHECK(!region_decode_chunk(&region, record, record_length, 0, 0, &loaded));
+
+    // The payload decompresses to a different length than the header says.
+    corrupted_header = chunk_header;
+    corrupted_header.payload_length -= 1;
+    memcpy(record, &corrupted_header, sizeof(corrupted_header));
+    TEST_CHECK(!region_decode_chunk(&region, record, record_length, 0, 0, &loaded));
+
+    // The payload is cut short.
+    corrupted_header = chunk_header;
+    corrupted_header.compressed_length /= 2;
+    memcpy(record, &corrupted_header, sizeof(corrupted_header));
+    TEST_CHECK(!region_decode_chunk(&region, record, record_length, 0, 0, &loaded));
+
+    free(record);
+    chunk_destroy(&chunk);
+    region_close(&region);
+    remove(test_region_path);
+}
+
+int main(void) {
+    test_codec_round_trips();
+    test_rle_rejects_invalid();
+    test_lz_rejects_invalid();
+    test_region_round_trip(REGION_MODE_COMPRESSED);
+    test_region_round_trip(REGION_MODE_UNCOMPRESSED);
+    test_region_rejects_invalid();
+
+    if (test_failure_count > 0) {
+        printf("%zu checks failed\n", test_failure_count);
+        return -1;
+    }
+
+    printf("All checks passed\n");
+
+    return 0;
+}
@@ -0,0 +1,121 @@
+// Builds an asset pack from loose files, each file's entry is named by the path it was given as.
+// Usage: asset_pack_builder <output.cbap> <file>...
+
+#include "../src/asset_pack.h"
+#include "../src/file.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct PackedFile {
+    char *path;
+    uint8_t *data;
+    size_t length;
+};
+
+int packed_file_compare(const void *a, const void *b) {
+    return strcmp(((const struct PackedFile *)a)->path, ((const struct PackedFile *)b)->path);
+}
+
+size_t align_offset(size_t offset) {
+    return (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+}
+
+bool write_zeros(FILE *file, size_t count) {
+    static const uint8_t zeros[ASSET_PACK_ALIGNMENT] = {0};
+
+    while (count > 0) {
+        size_t write_count = count < sizeof(zeros) ? count : sizeof(zeros);
+        if (fwrite(zeros, 1, write_count, file) != write_count) {
+            return false;
+        }
+
+        count -= write_count;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("Usage: %s <output.cbap> <file>...\n", argv[0]);
+        return -1;
+    }
+
+    char *output_path = argv[1];
+    uint32_t file_count = (uint32_t)(argc - 2);
+    struct PackedFile *files = malloc((file_count > 0 ? file_count : 1) * sizeof(struct PackedFile));
+    assert(files);
+
+    for (uint32_t i = 0; i < file_count; i++) {
+        char *path = argv[i + 2];
+        if (strlen(path) >= ASSET_PACK_NAME_LENGTH) {
+            printf("Path is too long to be an entry name: %s\n", path);
+            return -1;
+        }
+
+        files[i].path = path;
+        files[i].data = get_file_bytes(path, &files[i].length);
+        if (!files[i].data) {
+            printf("Failed to read file: %s\n", path);
+            return -1;
+        }
+    }
+
+    // The reader binary searches the table of contents.
+    qsort(files, file_count, sizeof(struct PackedFile), packed_file_compare);
+
+    struct AssetPackHeader header = (struct AssetPackHeader){
+        .version = ASSET_PACK_VERSION,
+        .entry_count = file_count,
+    };
+    memcpy(header.magic, asset_pack_magic, sizeof(asset_pack_magic));
+
+    struct AssetPackEntry *entries = calloc(file_count > 0 ? file_count : 1, sizeof(struct AssetPackEntry));
+    assert(entries);
+
+    size_t offset = align_offset(sizeof(header) + file_count * sizeof(struct AssetPackEntry));
+    for (uint32_t i = 0; i < file_count; i++) {
+        strcpy(entries[i].name, files[i].path);
+        entries[i].offset = offset;
+        entries[i].length = files[i].length;
+
+        // Leave room for the zero byte that terminates every entry.
+        offset = align_offset(offset + files[i].length + 1);
+    }
+
+    FILE *file = file_open(output_path, "wb");
+    if (!file) {
+        printf("Failed to open output: %s\n", output_path);
+        return -1;
+    }
+
+    bool was_written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                       fwrite(entries, sizeof(struct AssetPackEntry), file_count, file) == file_count;
+
+    size_t written_length = sizeof(header) + file_count * sizeof(struct AssetPackEntry);
+    for (uint32_t i = 0; i < file_count && was_written; i++) {
+        was_written = write_zeros(file, entries[i].offset - written_length) &&
+                      fwrite(files[i].data, 1, files[i].length, file) == files[i].length;
+        written_length = entries[i].offset + files[i].length;
+    }
+
+    was_written = was_written && write_zeros(file, offset - written_length);
+
+    if (fclose(file) != 0 || !was_written) {
+        printf("Failed to write asset pack: %s\n", output_path);
+        return -1;
+    }
+
+    printf("Wrote %s: %" PRIu32 " entries, %zu bytes\n", output_path, file_count, offset);
+
+    for (uint32_t i = 0; i < file_count; i++) {
+        free(files[i].data);
+    }
+    free(files);
+    free(entries);
+
+    return 0;
+}
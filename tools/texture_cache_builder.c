@@ -0,0 +1,64 @@
+// Builds a texture cache file from one or more images, each image becomes a layer of the cached texture.
+// Usage: texture_cache_builder <output.cbtc> <image.png>...
+
+#include "../src/graphics/texture_cache.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image/stb_image.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf("Usage: %s <output.cbtc> <image.png>...\n", argv[0]);
+        return -1;
+    }
+
+    char *output_path = argv[1];
+    uint32_t layer_count = (uint32_t)(argc - 2);
+    uint8_t **layers = malloc(layer_count * sizeof(uint8_t *));
+    assert(layers);
+
+    int width = 0;
+    int height = 0;
+
+    for (uint32_t i = 0; i < layer_count; i++) {
+        char *image_path = argv[i + 2];
+        int layer_width, layer_height, channel_count;
+        layers[i] = stbi_load(image_path, &layer_width, &layer_height, &channel_count, 4);
+
+        if (!layers[i]) {
+            printf("Failed to load image: %s\n", image_path);
+            return -1;
+        }
+
+        if (i == 0) {
+            width = layer_width;
+            height = layer_height;
+        } else if (layer_width != width || layer_height != height) {
+            printf("Image is a different size than the first layer: %s\n", image_path);
+            return -1;
+        }
+    }
+
+    struct TextureCache cache = texture_cache_create(layers, layer_count, width, height);
+
+    if (!texture_cache_save(&cache, output_path)) {
+        printf("Failed to write texture cache: %s\n", output_path);
+        return -1;
+    }
+
+    printf("Wrote %s: %dx%d, %" PRIu32 " layers, %" PRIu32 " levels\n", output_path, width, height, layer_count,
+        cache.header.level_count);
+
+    texture_cache_destroy(&cache);
+
+    for (uint32_t i = 0; i < layer_count; i++) {
+        stbi_image_free(layers[i]);
+    }
+    free(layers);
+
+    return 0;
+}